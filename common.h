@@ -59,10 +59,14 @@
 #include <linux/sched.h>
 #include <linux/kthread.h>
 #include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/completion.h>
 #include <linux/time.h>
+#include <linux/ktime.h>
 
 #include <linux/namei.h>
 #include <linux/vmalloc.h>
+#include <linux/firmware.h>
 #include <linux/timer.h>
 #include <linux/jiffies.h>
 #include <linux/module.h>
@@ -245,9 +249,8 @@ enum ili7807_types {
 #define CSV_LCM_OFF_PATH	"/sdcard/ilitek_mp_lcm_off_log"
 #define INI_NAME_PATH		"/sdcard/mp.ini"
 #define UPDATE_FW_PATH		"/sdcard/ILITEK_FW"
-#define POWER_STATUS_PATH 	"/sys/class/power_supply/battery/status"
-#define DUMP_FLASH_PATH		"/sdcard/flash_dump"
-#define CHECK_BATTERY_TIME  2000
+#define POWER_SUPPLY_NAME	"battery"
+#define CHARGER_DEBOUNCE_TIME	100
 #define CHECK_ESD_TIME		4000
 #define VDD_VOLTAGE			1800000
 #define VDD_I2C_VOLTAGE		1800000
@@ -290,7 +293,6 @@ enum ili7807_types {
 /* Be able to upgrade fw at boot stage */
 //#define BOOT_FW_UPGRADE
 #define BOOT_FW_HEX_NAME "ILITEK_FW"
-#define BOOT_UPDATE_FW_DELAY_TIME 10000
 
 /* Enable gesture function */
 //#define GESTURE_ENABLE
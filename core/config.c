@@ -296,6 +296,38 @@ int core_config_switch_fw_mode(uint8_t *data)
 }
 EXPORT_SYMBOL(core_config_switch_fw_mode);
 
+/* Read len bytes starting at addr with burst reads of SPI_READ_LEN, used for iram */
+int core_config_ice_mode_read_burst(uint32_t addr, uint8_t *data, uint32_t len)
+{
+	int ret = 0;
+	uint32_t i, size;
+	uint8_t szOutBuf[4] = { 0 };
+
+	for (i = 0; i < len; i += size, addr += size) {
+		size = min_t(uint32_t, len - i, SPI_READ_LEN);
+
+		szOutBuf[0] = 0x25;
+		szOutBuf[1] = (char)((addr & 0x000000FF) >> 0);
+		szOutBuf[2] = (char)((addr & 0x0000FF00) >> 8);
+		szOutBuf[3] = (char)((addr & 0x00FF0000) >> 16);
+
+		ret = core_write(core_config->slave_i2c_addr, szOutBuf, 4);
+		if (ret < 0)
+			goto out;
+
+		ret = core_read(core_config->slave_i2c_addr, data + i, size);
+		if (ret < 0)
+			goto out;
+	}
+
+	return 0;
+
+out:
+	ipio_err("Failed to burst read in ICE mode, ret = %d\n", ret);
+	return ret;
+}
+EXPORT_SYMBOL(core_config_ice_mode_read_burst);
+
 int core_config_ice_mode_write(uint32_t addr, uint32_t data, uint32_t size)
 {
 	int ret = 0, i;
@@ -510,23 +542,28 @@ EXPORT_SYMBOL(core_config_set_phone_cover);
 void core_config_ic_suspend(void)
 {
 	int i;
+	ktime_t start = ktime_get();
 
 	ipio_info("Starting to suspend ...\n");
 
 	core_fr->isEnableFR = false;
 	ilitek_platform_disable_irq();
 
+	ipd->isSuspend = true;
+	core_fr_scan_gov_stop();
 	if (ipd->isEnablePollCheckPower)
 		cancel_delayed_work_sync(&ipd->check_power_status_work);
 	if (ipd->isEnablePollCheckEsd)
 		cancel_delayed_work_sync(&ipd->check_esd_status_work);
 
 	/* sense stop */
+	core_config_int_wait_arm();
 	core_config_sense_ctrl(false);
 
 	/* check system busy */
 	if (core_config_check_cdc_busy(50, 50) < 0)
 		ipio_err("Check busy is timout !\n");
+	core_config_int_wait_disarm();
 
 	ipio_info("Enabled Gesture = %d\n", core_config->isEnableGesture);
 
@@ -540,6 +577,8 @@ void core_config_ic_suspend(void)
 		enable_irq_wake(ipd->isr_gpio);
 		core_fr->isEnableFR = true;
 		ilitek_platform_enable_irq();
+		core_gesture->suspend_ms = ktime_to_ms(ktime_sub(ktime_get(), start));
+		ipio_info("Gesture suspend took %lld ms\n", core_gesture->suspend_ms);
 		goto end;
 	}
 
@@ -577,9 +616,11 @@ void core_config_ic_resume(void)
 
 	core_config_switch_fw_mode(&protocol->demo_mode);
 
-	if (ipd->isEnablePollCheckPower)
-		queue_delayed_work(ipd->check_power_status_queue,
-			&ipd->check_power_status_work, ipd->work_delay);
+	/* the IC forgot the charger state while it was asleep */
+	ipd->isSuspend = false;
+	ilitek_platform_plug_refresh();
+	core_fr_scan_gov_restart();
+
 	if (ipd->isEnablePollCheckEsd)
 		queue_delayed_work(ipd->check_esd_status_queue,
 			&ipd->check_esd_status_work, ipd->esd_check_time);
@@ -737,11 +778,63 @@ int core_config_set_watch_dog(bool enable)
 }
 EXPORT_SYMBOL(core_config_set_watch_dog);
 
+/*
+ * Route the next INT edges to ipd->int_done instead of the finger report handler.
+ * It must be called before sending the command which makes fw toggle INT,
+ * otherwise the edge could be missed.
+ */
+void core_config_int_wait_arm(void)
+{
+	if (ipd->isr_gpio <= 0)
+		return;
+
+	reinit_completion(&ipd->int_done);
+	ipd->int_wait_irq = ipd->isEnableIRQ;
+	atomic_set(&ipd->int_wait, 1);
+	ilitek_platform_enable_irq();
+}
+EXPORT_SYMBOL(core_config_int_wait_arm);
+
+void core_config_int_wait_disarm(void)
+{
+	if (!atomic_read(&ipd->int_wait))
+		return;
+
+	if (!ipd->int_wait_irq)
+		ilitek_platform_disable_irq();
+
+	atomic_set(&ipd->int_wait, 0);
+}
+EXPORT_SYMBOL(core_config_int_wait_disarm);
+
+/*
+ * Sleep until an armed INT edge arrives. Returns the time waited in us,
+ * or -ETIME if nothing came within timeout (ms).
+ */
+int core_config_int_wait(int timeout)
+{
+	ktime_t start = ktime_get();
+
+	if (!atomic_read(&ipd->int_wait)) {
+		msleep(timeout);
+		return -ETIME;
+	}
+
+	if (!wait_for_completion_timeout(&ipd->int_done, msecs_to_jiffies(timeout)))
+		return -ETIME;
+
+	reinit_completion(&ipd->int_done);
+	return (int)ktime_us_delta(ktime_get(), start);
+}
+EXPORT_SYMBOL(core_config_int_wait);
+
 int core_config_check_cdc_busy(int conut, int delay)
 {
 	int timer = conut, ret = -1;
 	uint8_t cmd[2] = { 0 };
 	uint8_t busy = 0, busy_byte = 0;
+	bool armed = atomic_read(&ipd->int_wait);
+	ktime_t start = ktime_get();
 
 	cmd[0] = protocol->cmd_read_ctrl;
 	cmd[1] = protocol->cmd_cdc_busy;
@@ -755,7 +848,7 @@ int core_config_check_cdc_busy(int conut, int delay)
 		return -EINVAL;
 	}
 
-	ipio_debug(DEBUG_CONFIG, "busy byte = %x\n", busy_byte);
+	ipio_debug(DEBUG_CONFIG, "busy byte = %x, wait on INT = %d\n", busy_byte, armed);
 
 	while (timer > 0) {
 		core_write(core_config->slave_i2c_addr, cmd, 2);
@@ -765,17 +858,21 @@ int core_config_check_cdc_busy(int conut, int delay)
 		ipio_debug(DEBUG_CONFIG, "busy status = 0x%x\n", busy);
 
 		if (busy == busy_byte) {
-			ipio_info("Check busy is free\n");
 			ret = 0;
 			break;
 		}
 		timer--;
-		mdelay(delay);
+
+		/* If INT is armed, fw raising it ends the sleep early */
+		core_config_int_wait(delay);
 	}
 
 	if (ret == -1) {
 		ipio_err("Check busy (0x%x) timeout\n", busy);
 		core_config_read_pc_counter();
+	} else {
+		ipio_info("Check busy is free, took %lld us (%s)\n",
+			ktime_us_delta(ktime_get(), start), armed ? "INT" : "poll");
 	}
 
 	return ret;
@@ -785,30 +882,51 @@ EXPORT_SYMBOL(core_config_check_cdc_busy);
 int core_config_check_int_status(bool high)
 {
 	int timer = 1000, ret = -1;
+	int timeout = 5000, waited = 0;
+	ktime_t start = ktime_get();
 
 	/* From FW request, timeout should at least be 5 sec */
+	if (atomic_read(&ipd->int_wait)) {
+		/* Sleep until fw pulls INT down, then let the pulse finish */
+		waited = core_config_int_wait(timeout);
+		if (waited < 0)
+			goto out;
+
+		timer = (timeout * 1000 - waited) / 200;
+		while (timer) {
+			if (!!gpio_get_value(ipd->int_gpio) == high) {
+				ret = 0;
+				goto out;
+			}
+			usleep_range(200, 250);
+			timer--;
+		}
+		goto out;
+	}
+
 	while (timer) {
 		if (high) {
 			if (gpio_get_value(ipd->int_gpio)) {
-				ipio_info("Check busy is free\n");
 				ret = 0;
 				break;
 			}
 		} else {
 			if (!gpio_get_value(ipd->int_gpio)) {
-				ipio_info("Check busy is free\n");
 				ret = 0;
 				break;
 			}
 		}
 
-		mdelay(5);
+		msleep(5);
 		timer--;
 	}
 
+out:
 	if (ret == -1) {
 		ipio_err("Check INT timeout\n");
 		core_config_read_pc_counter();
+	} else {
+		ipio_info("Check busy is free, INT took %lld us\n", ktime_us_delta(ktime_get(), start));
 	}
 
 	return ret;
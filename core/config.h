@@ -105,6 +105,7 @@ extern int core_cmd_len;
 
 /* R/W with Touch ICs */
 extern uint32_t core_config_ice_mode_read(uint32_t addr);
+extern int core_config_ice_mode_read_burst(uint32_t addr, uint8_t *data, uint32_t len);
 extern int core_config_ice_mode_write(uint32_t addr, uint32_t data, uint32_t size);
 extern int core_config_ice_mode_bit_mask(uint32_t addr, uint32_t nMask, uint32_t value);
 extern uint32_t core_config_read_write_onebyte(uint32_t addr);
@@ -116,6 +117,9 @@ extern void core_config_read_flash_info(void);
 extern uint32_t core_config_read_pc_counter(void);
 extern int core_config_switch_fw_mode(uint8_t *data);
 extern int core_config_set_watch_dog(bool enable);
+extern void core_config_int_wait_arm(void);
+extern void core_config_int_wait_disarm(void);
+extern int core_config_int_wait(int timeout);
 extern int core_config_check_cdc_busy(int count, int delay);
 extern int core_config_check_int_status(bool high);
 extern void core_config_ic_suspend(void);
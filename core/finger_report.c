@@ -316,6 +316,106 @@ out:
 	return ret;
 }
 
+static void scan_rate_set(bool high, const char *why)
+{
+	struct scan_rate_event *ev;
+
+	if (core_fr->scan_high == high)
+		return;
+
+	core_config_tp_scan_mode(high);
+	core_fr->scan_high = high;
+
+	ev = &core_fr->scan_hist[core_fr->scan_hist_cnt % SCAN_HISTORY_NUM];
+	ev->ms = ktime_to_ms(ktime_get());
+	ev->high = high;
+	ev->why = why;
+	core_fr->scan_hist_cnt++;
+
+	ipio_debug(DEBUG_FINGER_REPORT, "Scan rate %s (%s)\n", high ? "high" : "low", why);
+}
+
+static void scan_rate_idle_work(struct work_struct *work)
+{
+	mutex_lock(&ipd->plat_mutex);
+	if (core_fr->isEnableScanGov && core_fr->scan_lock == SCAN_LOCK_NONE &&
+			core_fr->actual_fw_mode == protocol->demo_mode)
+		scan_rate_set(false, "idle");
+	mutex_unlock(&ipd->plat_mutex);
+}
+
+/*
+ * Called from the report path with plat_mutex held. Fingers down switch
+ * to high at once, while going low waits for scan_idle_time without any
+ * finger so that short gaps between touches don't make it flip.
+ */
+static void scan_rate_touch(int touch_num)
+{
+	if (!core_fr->isEnableScanGov || core_fr->scan_lock != SCAN_LOCK_NONE ||
+			core_fr->actual_fw_mode != protocol->demo_mode)
+		return;
+
+	if (touch_num > 0) {
+		cancel_delayed_work(&core_fr->scan_idle_work);
+		scan_rate_set(true, "touch");
+	} else {
+		mod_delayed_work(system_wq, &core_fr->scan_idle_work, core_fr->scan_idle_time);
+	}
+}
+
+void core_fr_scan_gov_set(bool enable, int lock)
+{
+	cancel_delayed_work_sync(&core_fr->scan_idle_work);
+
+	mutex_lock(&ipd->plat_mutex);
+	core_fr->isEnableScanGov = enable;
+	core_fr->scan_lock = lock;
+
+	/* Turning it off leaves the IC at its default rate */
+	scan_rate_set(!(enable && lock == SCAN_LOCK_LOW), "user");
+
+	/* Nothing is touching yet, so start counting the idle time */
+	if (enable && lock == SCAN_LOCK_NONE)
+		mod_delayed_work(system_wq, &core_fr->scan_idle_work, core_fr->scan_idle_time);
+	mutex_unlock(&ipd->plat_mutex);
+}
+EXPORT_SYMBOL(core_fr_scan_gov_set);
+
+void core_fr_scan_gov_stop(void)
+{
+	cancel_delayed_work_sync(&core_fr->scan_idle_work);
+}
+EXPORT_SYMBOL(core_fr_scan_gov_stop);
+
+/* The IC comes back from a reset or sleep scanning at its default (AB) */
+void core_fr_scan_gov_restart(void)
+{
+	core_fr->scan_high = true;
+
+	if (core_fr->isEnableScanGov)
+		core_fr_scan_gov_set(true, core_fr->scan_lock);
+}
+EXPORT_SYMBOL(core_fr_scan_gov_restart);
+
+/*
+ * Report traffic doubles as the ESD check: a few broken packets in a row
+ * mean the IC is in trouble, so recovery is started without a probe.
+ */
+static void fr_bad_report(void)
+{
+	core_fr->bad_report++;
+	core_fr->bad_report_total++;
+
+#ifdef ESD_CHECK
+	if (core_fr->bad_report < ESD_BAD_REPORT_MAX || !ipd->vesd_reg_nb)
+		return;
+
+	ipio_err("%d bad reports in a row, doing ESD recovery\n", core_fr->bad_report);
+	core_fr->bad_report = 0;
+	schedule_work(&ipd->esd_recovery);
+#endif
+}
+
 static int do_report_handle(void)
 {
 	int i, gesture, ret = 0;
@@ -334,12 +434,15 @@ static int do_report_handle(void)
 		ipio_err("Failed to read finger report packet\n");
 #ifdef HOST_DOWNLOAD
 		if (ret == CHECK_RECOVER) {
-			ipio_err("Doing host download recovery !\n");
-			ret = ilitek_platform_reset_ctrl(true, HW_RST_HOST_DOWNLOAD);
+			ipio_err("Doing ESD recovery !\n");
+			core_fr->bad_report = 0;
+			ret = ilitek_platform_esd_recover();
 			if (ret < 0)
-				ipio_info("host download failed!\n");
+				ipio_info("ESD recovery failed!\n");
+			goto out;
 		}
 #endif
+		fr_bad_report();
 		goto out;
 	}
 
@@ -367,11 +470,16 @@ static int do_report_handle(void)
 	ret = parse_report_data(pid);
 	if (ret < 0) {
 		ipio_err("Failed to parse packet of finger touch\n");
+		fr_bad_report();
 		goto out;
 	}
+	core_fr->bad_report = 0;
 
 	ipio_debug(DEBUG_FINGER_REPORT, "Touch Num = %d, LastTouch = %d\n", g_mutual_data.touch_num, last_touch);
 
+	if (g_mutual_data.touch_num > 0 || last_touch > 0)
+		scan_rate_touch(g_mutual_data.touch_num);
+
 	/* interpret parsed packat and send input events to system */
 	if (g_mutual_data.touch_num > 0) {
 #ifdef MT_B_TYPE
@@ -399,6 +507,12 @@ static int do_report_handle(void)
 #endif
 		input_sync(core_fr->input_device);
 
+		if (ipd->isWaitFirstTouch) {
+			ipd->isWaitFirstTouch = false;
+			ipd->unblank_touch_ms = ktime_to_ms(ktime_sub(ktime_get(), ipd->unblank_time));
+			ipio_info("First touch %lld ms after unblank\n", ipd->unblank_touch_ms);
+		}
+
 		last_touch = g_mutual_data.touch_num;
 	} else {
 		if (last_touch > 0) {
@@ -498,17 +612,6 @@ void core_fr_handler(void)
 		return;
 	}
 
-	if (ipd->isEnablePollCheckPower) {
-		mutex_lock(&ipd->plat_mutex);
-		cancel_delayed_work_sync(&ipd->check_power_status_work);
-		mutex_unlock(&ipd->plat_mutex);
-	}
-	if (ipd->isEnablePollCheckEsd) {
-		mutex_lock(&ipd->plat_mutex);
-		cancel_delayed_work_sync(&ipd->check_esd_status_work);
-		mutex_unlock(&ipd->plat_mutex);
-	}
-
 	g_total_len = calc_packet_length();
 
 	if (g_total_len <= 0) {
@@ -604,18 +707,11 @@ out:
 		ipio_kfree((void **)&g_fr_uart);
 	}
 
-	if (ipd->isEnablePollCheckPower) {
-		mutex_lock(&ipd->plat_mutex);
-		queue_delayed_work(ipd->check_power_status_queue,
-				&ipd->check_power_status_work, ipd->work_delay);
-		mutex_unlock(&ipd->plat_mutex);
-	}
-
+	/* The IC just talked to us, so only probe it after it's been idle */
 	if (ipd->isEnablePollCheckEsd) {
-		mutex_lock(&ipd->plat_mutex);
-		queue_delayed_work(ipd->check_esd_status_queue,
+		ipd->esd_idle_delay = ipd->esd_check_time;
+		mod_delayed_work(ipd->check_esd_status_queue,
 			&ipd->check_esd_status_work, ipd->esd_check_time);
-		mutex_unlock(&ipd->plat_mutex);
 	}
 
 	ipio_debug(DEBUG_IRQ, "handle INT done\n\n");
@@ -694,6 +790,12 @@ int core_fr_init(void)
 	core_fr->isSetResolution = false;
 	core_fr->actual_fw_mode = protocol->demo_mode;
 
+	core_fr->isEnableScanGov = false;
+	core_fr->scan_high = true;
+	core_fr->scan_lock = SCAN_LOCK_NONE;
+	core_fr->scan_idle_time = msecs_to_jiffies(SCAN_IDLE_TIME);
+	INIT_DELAYED_WORK(&core_fr->scan_idle_work, scan_rate_idle_work);
+
 	return 0;
 }
 EXPORT_SYMBOL(core_fr_init);
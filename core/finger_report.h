@@ -26,6 +26,24 @@
 #define __FINGER_REPORT_H
 
 #define CHECK_RECOVER 			-2
+/* Bad reports in a row before ESD recovery is started */
+#define ESD_BAD_REPORT_MAX		3
+
+/* Scan rate governor */
+#define SCAN_IDLE_TIME			1000	/* ms without fingers before going low */
+#define SCAN_HISTORY_NUM		64
+
+enum scan_lock {
+	SCAN_LOCK_NONE = 0,
+	SCAN_LOCK_HIGH,
+	SCAN_LOCK_LOW,
+};
+
+struct scan_rate_event {
+	s64 ms;		/* ktime in ms */
+	bool high;
+	const char *why;
+};
 
 struct core_fr_data {
 	struct input_dev *input_device;
@@ -52,6 +70,22 @@ struct core_fr_data {
 	uint8_t My;
 	uint8_t Sd;
 	uint8_t Ss;
+
+	/* reports that failed to read or parse, in a row and overall */
+	uint32_t bad_report;
+	uint32_t bad_report_total;
+
+	/*
+	 * Scan rate governor: AB scan (high) while fingers are down, B scan
+	 * (low) once the panel has been idle for scan_idle_time.
+	 */
+	bool isEnableScanGov;
+	bool scan_high;
+	int scan_lock;
+	unsigned long scan_idle_time;
+	struct delayed_work scan_idle_work;
+	struct scan_rate_event scan_hist[SCAN_HISTORY_NUM];
+	uint32_t scan_hist_cnt;
 };
 
 extern struct core_fr_data *core_fr;
@@ -60,6 +94,9 @@ extern uint8_t core_fr_calc_checksum(uint8_t *pMsg, uint32_t nLength);
 extern void core_fr_touch_press(int32_t x, int32_t y, uint32_t pressure, int32_t id);
 extern void core_fr_touch_release(int32_t x, int32_t y, int32_t id);
 extern void core_fr_handler(void);
+extern void core_fr_scan_gov_set(bool enable, int lock);
+extern void core_fr_scan_gov_stop(void);
+extern void core_fr_scan_gov_restart(void);
 extern void core_fr_input_set_param(struct input_dev *input_device);
 extern int core_fr_init(void);
 
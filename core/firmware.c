@@ -32,6 +32,8 @@
 #include <linux/version.h>
 #include <asm/uaccess.h>
 #include <linux/firmware.h>
+#include <linux/crc32.h>
+#include <linux/random.h>
 
 #include "../common.h"
 #include "../platform.h"
@@ -43,6 +45,8 @@
 #include "finger_report.h"
 #include "gesture.h"
 #include "mp_test.h"
+#include "fw_bin.h"
+#include "ili_hex.h"
 
 /* Firmware data with static array */
 #include "ilitek_fw.h"
@@ -53,82 +57,76 @@
 #define NO_NEED_UPDATE 	 0
 #define UPDATE_OK		 0
 #define FW_VER_ADDR	   0xFFE0
-#define TIMEOUT_SECTOR	 500
+/* Flash busy timeouts in ms */
+#define TIMEOUT_SECTOR	 1000
 #define TIMEOUT_PAGE	 3500
+#define TIMEOUT_PROGRAM	 10
+#define FLASH_PAGE_MAX	 256
+#define DELTA_MAX_SECTOR	(UPGRADE_BUFFER_SIZE / (4 * K))
+
+/* Typical erase time (ms) of the serial flashes we use, for planning only */
+#define ERASE_COST_SECTOR	 45
+#define ERASE_COST_HALF_BLOCK	 120
+#define ERASE_COST_BLOCK	 150
+/* The built-in image is const, so it can be used in place */
+#define ILI_FW_IMAGE		((u8 *)CTPM_FW + ILI_FILE_HEADER)
+#define ILI_FW_IMAGE_LEN	(sizeof(CTPM_FW) - ILI_FILE_HEADER)
 #define CRC_ONESET(X, Y)	({Y = (*(X+0) << 24) | (*(X+1) << 16) | (*(X+2) << 8) | (*(X+3));})
 
+struct flash_delta {
+	DECLARE_BITMAP(good, FW_BLOCK_INFO_NUM);
+
+	int nr;
+	DECLARE_BITMAP(dirty, DELTA_MAX_SECTOR);
+	DECLARE_BITMAP(blank, DELTA_MAX_SECTOR);
+
+	/* erase commands, in address order */
+	int cnt;
+	struct {
+		uint32_t addr;
+		uint32_t size;
+	} op[DELTA_MAX_SECTOR];
+};
+
 struct flash_sector *g_flash_sector = NULL;
 struct flash_block_info fbi[FW_BLOCK_INFO_NUM];
 struct core_firmware_data *core_firmware = NULL;
 u8 gestrue_fw[(10 * K)];
 
-static int convert_hex_file(u8 *phex, uint32_t nSize, u8 *pfw);
-
-static uint32_t HexToDec(char *pHex, int32_t nLength)
-{
-	uint32_t nRetVal = 0, nTemp = 0, i;
-	int32_t nShift = (nLength - 1) * 4;
-
-	for (i = 0; i < nLength; nShift -= 4, i++) {
-		if ((pHex[i] >= '0') && (pHex[i] <= '9')) {
-			nTemp = pHex[i] - '0';
-		} else if ((pHex[i] >= 'a') && (pHex[i] <= 'f')) {
-			nTemp = (pHex[i] - 'a') + 10;
-		} else if ((pHex[i] >= 'A') && (pHex[i] <= 'F')) {
-			nTemp = (pHex[i] - 'A') + 10;
-		} else {
-			return -1;
-		}
-
-		nRetVal |= (nTemp << nShift);
-	}
+/* Block crcs of the built-in image never change, compute them only once */
+static uint32_t ili_fw_crc[FW_BLOCK_INFO_NUM];
+static bool ili_fw_crc_valid = false;
 
-	return nRetVal;
-}
+static int convert_hex_file(u8 *phex, uint32_t nSize, u8 *pfw);
+static uint32_t calc_crc32(uint32_t start_addr, uint32_t len, uint8_t *data);
 
 static int write_download(uint32_t start, uint32_t size, uint8_t *w_buf, uint32_t w_len)
 {
-	int addr = 0, i = 0, update_status = 0, j = 0;
+	uint32_t addr = 0, i = 0, len = 0;
 	uint32_t end = start + size;
-	uint8_t *buf = NULL;
+	uint8_t head[4] = { 0 };
 
-    buf = (uint8_t*)kmalloc(sizeof(uint8_t) * size + 4, GFP_KERNEL);
+	/* Payload is sent straight from the image, only the header is built here */
+	for (addr = start, i = 0; addr < end; addr += len, i += len) {
+		len = min(w_len, end - addr);
 
-	if (ERR_ALLOC_MEM(buf)) {
-		ipio_err("Failed to allocate a buffer to be read, %ld\n", PTR_ERR(buf));
-		return -ENOMEM;
-	}
-
-	memset(buf, 0xFF, (int)sizeof(uint8_t) * size + 4);
-
-	for (addr = start, i = 0; addr < end; addr += w_len, i += w_len) {
-		if ((addr + w_len) > end)
-			w_len = end % w_len;
+		head[0] = 0x25;
+		head[3] = (char)((addr & 0x00FF0000) >> 16);
+		head[2] = (char)((addr & 0x0000FF00) >> 8);
+		head[1] = (char)((addr & 0x000000FF));
 
-		buf[0] = 0x25;
-		buf[3] = (char)((addr & 0x00FF0000) >> 16);
-		buf[2] = (char)((addr & 0x0000FF00) >> 8);
-		buf[1] = (char)((addr & 0x000000FF));
-
-		for (j = 0; j < w_len; j++)
-			buf[4 + j] = w_buf[i + j];
-
-		if (core_write(core_config->slave_i2c_addr, buf, w_len + 4)) {
-			ipio_err("Failed to write data via SPI in host download (%x)\n", w_len);
-			ipio_kfree((void **)&buf);
+		if (core_write_sg(core_config->slave_i2c_addr, head, sizeof(head), w_buf + i, len)) {
+			ipio_err("Failed to write data via SPI in host download (%x)\n", len);
 			return -EIO;
 		}
-
-		update_status = (i * 101) / end;
-		//printk("%cupgrade firmware(mp code), %02d%c", 0x0D, update_status, '%');
 	}
 
-	ipio_kfree((void **)&buf);
 	return 0;
 }
 
 static void fw_upgrade_info_setting(u8 *pfw, u8 type)
 {
+	int i = 0;
 	uint32_t  ges_info_addr, ges_fw_start, ges_fw_end;
 
 	if (type == UPGRADE_IRAM) {
@@ -171,11 +169,14 @@ static void fw_upgrade_info_setting(u8 *pfw, u8 type)
 		memset(gestrue_fw, 0xff, sizeof(gestrue_fw));
 
 #ifdef GESTURE_ENABLE
-		/* Parsing gesture info and code */
-		if (fbi[GESTURE].mem_start != 0xffffffff && ges_fw_start != 0xffffffff && fbi[GESTURE].mem_start != 0 && ges_fw_start != 0)
+		/* Parsing gesture info and code, it stays resident for gesture suspend */
+		core_gesture->code_valid = false;
+		if (fbi[GESTURE].mem_start != 0xffffffff && ges_fw_start != 0xffffffff && fbi[GESTURE].mem_start != 0 && ges_fw_start != 0) {
 			ipio_memcpy(gestrue_fw, (pfw + ges_fw_start), fbi[GESTURE].len, sizeof(gestrue_fw));
-		else
+			core_gesture->code_valid = true;
+		} else {
 			ipio_err("There is no gesture data inside fw\n");
+		}
 
 		core_gesture->ap_length = MAX_GESTURE_FIRMWARE_SIZE;
 
@@ -194,6 +195,25 @@ static void fw_upgrade_info_setting(u8 *pfw, u8 type)
 		fbi[DATA].mode = fbi[AP].mode = fbi[TUNING].mode = AP;
 		fbi[MP].mode = MP;
 		fbi[GESTURE].mode = GESTURE;
+
+		/* crc of each block is computed once here, not on every download */
+		for (i = 0; i < ARRAY_SIZE(fbi); i++) {
+			if (fbi[i].len < 4)
+				continue;
+
+			if (pfw == ILI_FW_IMAGE && ili_fw_crc_valid)
+				fbi[i].crc = ili_fw_crc[i];
+			else if (i == GESTURE)
+				fbi[i].crc = calc_crc32(0, fbi[i].len - 4, gestrue_fw);
+			else
+				fbi[i].crc = calc_crc32(fbi[i].start, fbi[i].len - 4, pfw);
+
+			if (pfw == ILI_FW_IMAGE)
+				ili_fw_crc[i] = fbi[i].crc;
+		}
+
+		if (pfw == ILI_FW_IMAGE)
+			ili_fw_crc_valid = true;
 	}
 
 	/* Get hex fw vers */
@@ -206,7 +226,7 @@ static void fw_upgrade_info_setting(u8 *pfw, u8 type)
 	ipio_info("nStartAddr = 0x%06X, nEndAddr = 0x%06X, block_number(AF) = %d\n", core_firmware->start_addr, core_firmware->end_addr, core_firmware->block_number);
 }
 
-static void convert_ili_file(u8 *pfw)
+static void parse_ili_file(void)
 {
 	int i = 0, block_enable = 0, num = 0;
 
@@ -246,80 +266,72 @@ static void convert_ili_file(u8 *pfw)
 
 out:
 	core_firmware->block_number = CTPM_FW[33];
-
-	memcpy(pfw, CTPM_FW + ILI_FILE_HEADER, (sizeof(CTPM_FW) - ILI_FILE_HEADER));
-	core_firmware->end_addr = (sizeof(CTPM_FW) - ILI_FILE_HEADER);
+	core_firmware->end_addr = min_t(uint32_t, ILI_FW_IMAGE_LEN, UPGRADE_BUFFER_SIZE);
 }
 
-static int convert_hex_file(u8 *phex, uint32_t nSize, u8 *pfw)
+static void convert_ili_file(u8 *pfw)
 {
-	int block = 0;
-	uint32_t i = 0, j = 0, k = 0, num = 0;
-	uint32_t nLength = 0, nAddr = 0, nType = 0;
-	uint32_t nStartAddr = 0x0, nEndAddr = 0x0, nExAddr = 0;
-	uint32_t nOffset;
-
-	memset(fbi, 0x0, sizeof(fbi));
+	parse_ili_file();
+	memcpy(pfw, ILI_FW_IMAGE, min_t(uint32_t, ILI_FW_IMAGE_LEN, UPGRADE_BUFFER_SIZE));
+}
 
-	/* Parsing HEX file */
-	for (; i < nSize;) {
-		nLength = HexToDec(&phex[i + 1], 2);
-		nAddr = HexToDec(&phex[i + 3], 4);
-		nType = HexToDec(&phex[i + 7], 2);
-
-		if (nType == 0x04) {
-			nExAddr = HexToDec(&phex[i + 9], 4);
-		} else if (nType == 0x02) {
-			nExAddr = HexToDec(&phex[i + 9], 4);
-			nExAddr = nExAddr >> 12;
-		} else if (nType == BLOCK_TAG_AE || nType == BLOCK_TAG_AF) {
-			/* insert block info extracted from hex */
-			core_firmware->hex_tag = nType;
-			if (core_firmware->hex_tag == BLOCK_TAG_AF)
-				num = HexToDec(&phex[i + 9 + 6 + 6], 2);
-			else
-				num = block;
+/*
+ * Everything reading pfw assumes UPGRADE_BUFFER_SIZE bytes behind it, so the
+ * built-in image is only used in place when it's at least that long.
+ * Otherwise it's copied into a padded buffer as before.
+ */
+static u8 *ili_file_get(void)
+{
+	if (ILI_FW_IMAGE_LEN < UPGRADE_BUFFER_SIZE)
+		return NULL;
 
-			fbi[num].start = HexToDec(&phex[i + 9], 6);
-			fbi[num].end = HexToDec(&phex[i + 9 + 6], 6);
-			fbi[num].fix_mem_start = INT_MAX;
-			fbi[num].len = fbi[num].end - fbi[num].start + 1;
-			ipio_info("Block[%d]: start_addr = %x, end = %x", num, fbi[num].start, fbi[num].end);
+	parse_ili_file();
+	ipio_info("Use built-in fw in place, size = %d\n", (int)ILI_FW_IMAGE_LEN);
+	return ILI_FW_IMAGE;
+}
 
-			block++;
-		} else if (nType == BLOCK_TAG_B0 && core_firmware->hex_tag == BLOCK_TAG_AF) {
-			num = HexToDec(&phex[i + 9 + 6], 2);
-			fbi[num].fix_mem_start = HexToDec(&phex[i + 9], 6);
-			ipio_info("number = 0x%x, fix_mem_start = 0x%x",num, fbi[num].fix_mem_start);
-		}
+/*
+ * Intel HEX in a single pass, with the decoder in ili_hex.h that the host
+ * test runs too. Block info records fill fbi[].
+ */
+static int convert_hex_file(u8 *phex, uint32_t nSize, u8 *pfw)
+{
+	int i, ret = 0;
+	struct ili_hex_info info;
+	struct ili_hex_block *b = NULL;
+	ktime_t t = ktime_get();
+	s64 us = 0;
 
-		nAddr = nAddr + (nExAddr << 16);
+	memset(fbi, 0x0, sizeof(fbi));
 
-		if (phex[i + 1 + 2 + 4 + 2 + (nLength * 2) + 2] == 0x0D)
-			nOffset = 2;
-		else
-			nOffset = 1;
+	ret = ili_hex_decode(phex, nSize, pfw, MAX_HEX_FILE_SIZE, &info);
+	if (ret < 0) {
+		ipio_err("%s before offset %d\n", (ret == ILI_HEX_ECHECKSUM) ?
+			"Hex record checksum error" : "Invalid hex record", info.err_offset);
+		return -1;
+	}
 
-		if (nAddr > MAX_HEX_FILE_SIZE) {
-			ipio_err("Invalid hex format %d\n", nAddr);
-			return -1;
-		}
+	for (i = 0; i < FW_BLOCK_INFO_NUM; i++) {
+		b = &info.block[i];
+		fbi[i].fix_mem_start = (b->fix_mem_start == ILI_HEX_NO_MEM) ? INT_MAX : b->fix_mem_start;
+		if (b->start == 0 && b->end == 0)
+			continue;
 
-		if (nType == 0x00) {
-			nEndAddr = nAddr + nLength;
-			if (nAddr < nStartAddr)
-				nStartAddr = nAddr;
-			/* fill data */
-			for (j = 0, k = 0; j < (nLength * 2); j += 2, k++)
-				pfw[nAddr + k] = HexToDec(&phex[i + 9 + j], 2);
-		}
-		i += 1 + 2 + 4 + 2 + (nLength * 2) + 2 + nOffset;
+		fbi[i].start = b->start;
+		fbi[i].end = b->end;
+		fbi[i].len = fbi[i].end - fbi[i].start + 1;
+		ipio_info("Block[%d]: start_addr = %x, end = %x, fix_mem_start = 0x%x\n",
+			i, fbi[i].start, fbi[i].end, fbi[i].fix_mem_start);
 	}
 
-	core_firmware->start_addr = nStartAddr;
-	core_firmware->end_addr = nEndAddr;
-	core_firmware->block_number = block;
+	core_firmware->hex_tag = info.hex_tag;
+	core_firmware->start_addr = info.start_addr;
+	core_firmware->end_addr = info.end_addr;
+	core_firmware->block_number = info.block_number;
 
+	us = ktime_us_delta(ktime_get(), t);
+	ipio_info("Parsed %d bytes of hex in %lld us (%lld KB/s)\n",
+		nSize, us, div_s64((s64)nSize * 1000, (us > 0) ? us : 1));
 	return 0;
 }
 
@@ -337,8 +349,13 @@ static int hex_file_open_convert(u8 open_file_method, u8 *pfw)
 
 	switch (open_file_method) {
 		case REQUEST_FIRMWARE:
+			if (core_firmware->fw_req != NULL) {
+				/* Loaded asynchronously, parse it where it is */
+				ipio_info("Convert the requested file, size = %d\n", (int)core_firmware->fw_req->size);
+				return convert_hex_file((u8 *)core_firmware->fw_req->data, core_firmware->fw_req->size, pfw);
+			}
+
 			ipio_info("Request_firmware_file, name = %s \n", BOOT_FW_HEX_NAME);
-			msleep(BOOT_UPDATE_FW_DELAY_TIME);
 			ret = request_firmware(&fw, BOOT_FW_HEX_NAME, ipd->dev);
 			if (ret < 0) {
 				ipio_err("Failed to open the file Name %s,try to open ili file\n", BOOT_FW_HEX_NAME);
@@ -402,12 +419,100 @@ static int hex_file_open_convert(u8 open_file_method, u8 *pfw)
 	}
 
 	/* Convert hex and copy data from hex_buffer to pfw */
-	convert_hex_file(hex_buffer, fsize, pfw);
+	if (hex_buffer != NULL)
+		ret = convert_hex_file(hex_buffer, fsize, pfw);
 
 	ipio_vfree((void **)&hex_buffer);
 	return ret;
 }
 
+/*
+ * Check a container made by tools/ili_fw_pack and take fbi[] and the image
+ * bounds from its header. Returns the payload, which is used in place as
+ * pfw, or NULL if fw isn't a valid container.
+ */
+static u8 *fw_bin_open(const struct firmware *fw)
+{
+	const struct ili_fw_bin_header *hdr = (const struct ili_fw_bin_header *)fw->data;
+	const struct ili_fw_bin_block *b;
+	uint32_t i, hlen, fix;
+	u8 *payload;
+
+	if (fw->size < sizeof(*hdr) || le32_to_cpu(hdr->magic) != ILI_FW_BIN_MAGIC)
+		return NULL;
+
+	if (le32_to_cpu(hdr->version) != ILI_FW_BIN_VERSION) {
+		ipio_err("Unknown fw container version %d\n", le32_to_cpu(hdr->version));
+		return NULL;
+	}
+
+	if (crc32_be(0xFFFFFFFF, fw->data, offsetof(struct ili_fw_bin_header, header_crc)) !=
+			le32_to_cpu(hdr->header_crc)) {
+		ipio_err("fw container header crc error\n");
+		return NULL;
+	}
+
+	hlen = le32_to_cpu(hdr->header_len);
+	if (hlen < sizeof(*hdr) || le32_to_cpu(hdr->payload_len) != UPGRADE_BUFFER_SIZE ||
+			fw->size < hlen + UPGRADE_BUFFER_SIZE || le32_to_cpu(hdr->end_addr) > UPGRADE_BUFFER_SIZE) {
+		ipio_err("fw container layout doesn't match, size = %d\n", (int)fw->size);
+		return NULL;
+	}
+
+	payload = (u8 *)fw->data + hlen;
+	if (calc_crc32(0, UPGRADE_BUFFER_SIZE, payload) != le32_to_cpu(hdr->payload_crc)) {
+		ipio_err("fw container payload crc error\n");
+		return NULL;
+	}
+
+	memset(fbi, 0x0, sizeof(fbi));
+
+	for (i = 0; i < ILI_FW_BIN_BLOCKS && i < FW_BLOCK_INFO_NUM; i++) {
+		b = &hdr->block[i];
+		if (le32_to_cpu(b->end) == 0)
+			continue;
+
+		fbi[i].start = le32_to_cpu(b->start);
+		fbi[i].end = le32_to_cpu(b->end);
+		fbi[i].len = fbi[i].end - fbi[i].start + 1;
+		fix = le32_to_cpu(b->fix_mem_start);
+		fbi[i].fix_mem_start = (fix == ILI_FW_BIN_NO_MEM) ? INT_MAX : fix;
+
+		if (fbi[i].end >= UPGRADE_BUFFER_SIZE || fbi[i].start > fbi[i].end || fbi[i].len < 4 ||
+				calc_crc32(fbi[i].start, fbi[i].len - 4, payload) != le32_to_cpu(b->crc)) {
+			ipio_err("fw container block[%d] is invalid\n", i);
+			return NULL;
+		}
+
+		ipio_info("Block[%d]: start_addr = %x, end = %x\n", i, fbi[i].start, fbi[i].end);
+	}
+
+	core_firmware->hex_tag = le32_to_cpu(hdr->hex_tag);
+	core_firmware->block_number = le32_to_cpu(hdr->block_number);
+	core_firmware->start_addr = le32_to_cpu(hdr->start_addr);
+	core_firmware->end_addr = le32_to_cpu(hdr->end_addr);
+
+	ipio_info("Use fw container in place, ver = 0x%x\n", le32_to_cpu(hdr->fw_ver));
+	return payload;
+}
+
+/*
+ * The loader's buffer is used directly if it holds a container. Anything
+ * else is left in fw_req for the hex parser, so the file is loaded once.
+ */
+static u8 *fw_bin_get(void)
+{
+	if (core_firmware->fw_req == NULL) {
+		if (request_firmware(&core_firmware->fw_bin, BOOT_FW_HEX_NAME, ipd->dev) < 0) {
+			core_firmware->fw_bin = NULL;
+			return NULL;
+		}
+		core_firmware->fw_req = core_firmware->fw_bin;
+	}
+
+	return fw_bin_open(core_firmware->fw_req);
+}
+
 static int fw_upgrade_file_convert(int target, u8 *pfw, int open_file_method)
 {
 	int ret = 0;
@@ -422,6 +527,7 @@ static int fw_upgrade_file_convert(int target, u8 *pfw, int open_file_method)
 				/* Feed ili file if can't find hex file from filesystem. */
 			if (hex_file_open_convert(open_file_method, pfw) < 0) {
 				ipio_err("Open hex file fail, try ili file upgrade");
+				memset(pfw, 0xFF, UPGRADE_BUFFER_SIZE);
 				convert_ili_file(pfw);
 			}
 			break;
@@ -435,7 +541,7 @@ static int fw_upgrade_file_convert(int target, u8 *pfw, int open_file_method)
 
 static int host_download_dma_check(uint32_t start_addr, uint32_t block_size)
 {
-	int count = 50;
+	int count = 50, delay = 100;
 	uint32_t busy = 0;
 
 	/* dma1 src1 adress */
@@ -470,14 +576,15 @@ static int host_download_dma_check(uint32_t start_addr, uint32_t block_size)
 	/* Dma1 start */
 	core_config_ice_mode_write(0x072100, 0x01000000, 4);
 
-	/* Polling BIT0 */
+	/* Polling BIT0, backing off from 100us up to 1ms between reads */
 	while (count > 0) {
-		mdelay(1);
+		usleep_range(delay, delay + 50);
 		busy = core_config_read_write_onebyte(0x048006);
 
 		if ((busy & 0x01) == 1)
 			break;
 
+		delay = min(delay * 2, 1000);
 		count--;
 	}
 
@@ -623,7 +730,7 @@ static int tddi_read_flash(uint32_t start, uint32_t end, uint8_t *data, int dlen
 		core_config_ice_mode_write(0x041008, 0xFF, 1);	/* Dummy */
 
 		data[cont] = core_config_read_write_onebyte(0x41010);
-		ipio_info("data[%d] = %x\n", cont, data[cont]);
+		ipio_debug(DEBUG_FIRMWARE, "data[%d] = %x\n", cont, data[cont]);
 		cont++;
 	}
 
@@ -631,49 +738,74 @@ static int tddi_read_flash(uint32_t start, uint32_t end, uint8_t *data, int dlen
 	return 0;
 }
 
-int core_dump_flash(void)
+/*
+ * Read the whole flash into a vmalloc'd buffer for the dump_flash node.
+ * Caller holds plat_mutex with the check works stopped, and frees *data.
+ */
+int core_dump_flash(uint8_t **data, uint32_t *len)
 {
-	struct file *f = NULL;
+	int ret = 0;
 	uint8_t *hex_buffer = NULL;
-	mm_segment_t old_fs;
-	loff_t pos = 0;
-	u32 start_addr = 0x0, end_addr = 0x1FFFF;
-	int length;
-
-	core_config_ice_mode_enable(STOP_MCU);
-
-	f = filp_open(DUMP_FLASH_PATH, O_WRONLY | O_CREAT | O_TRUNC, 644);
-	if (ERR_ALLOC_MEM(f)) {
-		ipio_err("Failed to open the file at %ld.\n", PTR_ERR(f));
-		goto out;
-	}
+	u32 start_addr = 0x0, end_addr = core_firmware->max_count;
+	uint32_t length;
 
 	length = end_addr - start_addr + 1;
 
 	hex_buffer = vmalloc(length * sizeof(uint8_t));
 	if (ERR_ALLOC_MEM(hex_buffer)) {
 		ipio_err("Failed to allocate hex_buffer memory, %ld\n", PTR_ERR(hex_buffer));
-		filp_close(f, NULL);
+		return -ENOMEM;
+	}
+
+	ret = core_config_ice_mode_enable(STOP_MCU);
+	if (ret < 0) {
+		ipio_err("Failed to enable ICE mode\n");
 		goto out;
 	}
 
-	tddi_read_flash(start_addr, end_addr, hex_buffer, length);
+	ret = core_flash_dma_read(start_addr, hex_buffer, length);
+	core_config_ice_mode_disable();
 
-	old_fs = get_fs();
-	set_fs(get_ds());
-	set_fs(KERNEL_DS);
-	pos = 0;
-	vfs_write(f, hex_buffer, length, &pos);
-	set_fs(old_fs);
-	filp_close(f, NULL);
+	/* iram was used as the dma buffer */
+	ilitek_platform_reset_ctrl(true, RST_METHODS);
 
-	ipio_info("dump flash success\n");
+	if (ret < 0) {
+		ipio_err("Failed to read flash\n");
+		goto out;
+	}
 
+	*data = hex_buffer;
+	*len = length;
 	return 0;
 
 out:
-	core_config_ice_mode_disable();
-	return -1;
+	ipio_vfree((void **)&hex_buffer);
+	return ret;
+}
+
+static void store_current_fw_ver(void)
+{
+	if (protocol->major >= 0x5 && protocol->mid >= 0x3) {
+		core_firmware->current_fw_cb = (core_config->firmware_ver[1] << 24) |
+			(core_config->firmware_ver[2] << 16)| (core_config->firmware_ver[3] << 8) | core_config->firmware_ver[4];
+	} else {
+		core_firmware->current_fw_cb = (core_config->firmware_ver[1] << 16) |
+			(core_config->firmware_ver[2] << 8)| core_config->firmware_ver[3];
+	}
+}
+
+/*
+ * The version was read with the normal protocol command at probe. A match
+ * alone doesn't prove the flash is intact, see fw_upgrade_flash().
+ */
+static bool fw_ver_is_current(void)
+{
+	store_current_fw_ver();
+
+	if (core_firmware->current_fw_cb == 0 || core_firmware->current_fw_cb == 0xFFFFFFFF)
+		return false;
+
+	return core_firmware->new_fw_cb == core_firmware->current_fw_cb;
 }
 
 static int check_fw_upgrade(u8 *pfw)
@@ -696,13 +828,7 @@ static int check_fw_upgrade(u8 *pfw)
 	}
 
 	/* Store current fw version */
-	if (protocol->major >= 0x5 && protocol->mid >= 0x3) {
-		core_firmware->current_fw_cb = (core_config->firmware_ver[1] << 24) |
-			(core_config->firmware_ver[2] << 16)| (core_config->firmware_ver[3] << 8) | core_config->firmware_ver[4];
-	} else {
-		core_firmware->current_fw_cb = (core_config->firmware_ver[1] << 16) |
-			(core_config->firmware_ver[2] << 8)| core_config->firmware_ver[3];
-	}
+	store_current_fw_ver();
 
 	/* Check FW version */
 	ipio_info("New FW ver = 0x%x, Current FW ver = 0x%x\n", core_firmware->new_fw_cb, core_firmware->current_fw_cb);
@@ -780,7 +906,7 @@ check_flash_crc:
 	return ret;
 }
 
-static int do_erase_flash(uint32_t start_addr)
+static int do_erase_flash(uint32_t start_addr, uint32_t size)
 {
 	int ret = 0;
 	uint32_t rev_addr;
@@ -794,8 +920,10 @@ static int do_erase_flash(uint32_t start_addr)
 	core_config_ice_mode_write(0x041000, 0x0, 1);	/* CS low */
 	core_config_ice_mode_write(0x041004, 0x66aa55, 3);	/* Key */
 
-	if (start_addr == fbi[AP].start)
+	if (size == flashtab->block)
 		core_config_ice_mode_write(0x041008, 0xD8, 1);
+	else if (size == flashtab->half_block)
+		core_config_ice_mode_write(0x041008, 0x52, 1);
 	else
 		core_config_ice_mode_write(0x041008, 0x20, 1);
 
@@ -806,7 +934,7 @@ static int do_erase_flash(uint32_t start_addr)
 
 	mdelay(1);
 
-	if (start_addr == fbi[AP].start)
+	if (size == flashtab->block || size == flashtab->half_block)
 		ret = core_flash_poll_busy(TIMEOUT_PAGE);
 	else
 		ret = core_flash_poll_busy(TIMEOUT_SECTOR);
@@ -816,7 +944,7 @@ static int do_erase_flash(uint32_t start_addr)
 
 	core_config_ice_mode_write(0x041000, 0x1, 1);	/* CS high */
 
-	ipio_debug(DEBUG_FIRMWARE, "Earsing data at start addr: %x\n", start_addr);
+	ipio_debug(DEBUG_FIRMWARE, "Earsing data at start addr: %x, size = %d\n", start_addr, size);
 
 out:
 	return ret;
@@ -831,7 +959,11 @@ static int flash_erase(void)
 			continue;
 		ipio_debug(DEBUG_FIRMWARE, "Block[%d] earsing start 0x%x to end 0x%x \n", i, fbi[i].start, fbi[i].end);
 		for(j = fbi[i].start; j <= fbi[i].end; j+= flashtab->sector) {
-			ret = do_erase_flash(j);
+			if (core_firmware->isCancel) {
+				ret = -ECANCELED;
+				goto out;
+			}
+			ret = do_erase_flash(j, (j == fbi[AP].start) ? flashtab->block : flashtab->sector);
 			if (ret < 0)
 				goto out;
 			if (fbi[i].start == fbi[AP].start)
@@ -843,11 +975,10 @@ out:
 	return ret;
 }
 
-static int do_program_flash(uint32_t start_addr, u8* pfw)
+/* Fill buf with the ICE burst for one page, returns false if it's all 0xFF */
+static bool flash_page_stage(uint32_t start_addr, u8 *pfw, u8 *buf)
 {
-	int ret = 0;
-	uint32_t k, rev_addr;
-	uint8_t buf[512] = { 0 };
+	uint32_t k;
 	bool skip = true;
 
 	buf[0] = 0x25;
@@ -865,10 +996,13 @@ static int do_program_flash(uint32_t start_addr, u8* pfw)
 			skip = false;
 	}
 
-	if (skip) {
-		core_config_ice_mode_write(0x041000, 0x1, 1);	/* CS high */
-		goto out;
-	}
+	return !skip;
+}
+
+static int do_program_flash(uint32_t start_addr, u8 *buf)
+{
+	int ret = 0;
+	uint32_t rev_addr, status;
 
 	ret = core_flash_write_enable();
 	if (ret < 0)
@@ -882,28 +1016,78 @@ static int do_program_flash(uint32_t start_addr, u8* pfw)
 	core_config_ice_mode_write(0x041008, rev_addr, 3);
 
 	if (core_write(core_config->slave_i2c_addr, buf, flashtab->program_page + 4) < 0) {
-		ipio_err("Failed to write data at start_addr = 0x%X, k = 0x%X, addr = 0x%x\n",
-			start_addr, k, start_addr + k);
+		ipio_err("Failed to write data at start_addr = 0x%X\n", start_addr);
 		ret = -EIO;
 		goto out;
 	}
 
 	core_config_ice_mode_write(0x041000, 0x1, 1);	/* CS high */
 
-	if (flashtab->mid == 0x85)
-		mdelay(2);
-	else
-		mdelay(1);
-
-	core_firmware->update_status = (start_addr * 101) / core_firmware->end_addr;
+	status = (start_addr * 101) / core_firmware->end_addr;
 
 	/* holding the status until finish this upgrade. */
-	if (core_firmware->update_status > 90)
-		core_firmware->update_status = 90;
+	if (status > 90)
+		status = 90;
 
-	/* Don't use ipio_info to print log because it needs to be kpet in the same line */
-	//printk(KERN_CONT "%c ILITEK: Upgrading firmware ... start_addr = 0x%x, %02d%c \n", 0x0D,
-			//start_addr, core_firmware->update_status,'%');
+	if (status != core_firmware->update_status) {
+		core_firmware->update_status = status;
+		core_firmware->event++;
+		wake_up_interruptible(&core_firmware->wq);
+	}
+
+out:
+	return ret;
+}
+
+/*
+ * Program the pages of [start, start + len). The burst for the next page is
+ * built while the flash is still busy with the current one, and the status
+ * register rather than a fixed delay tells when it may be sent. Returns the
+ * number of bytes programmed.
+ */
+static int flash_program_range(uint32_t start, uint32_t len, u8 *pfw)
+{
+	int ret = 0, cur = 0, bytes = 0;
+	uint32_t addr, page = flashtab->program_page;
+	uint8_t buf[2][4 + FLASH_PAGE_MAX];
+	bool valid, send;
+
+	if (page > FLASH_PAGE_MAX) {
+		ipio_err("Program page %d is too large\n", page);
+		return -EINVAL;
+	}
+
+	valid = flash_page_stage(start, pfw, buf[cur]);
+
+	for (addr = start; addr < start + len; addr += page) {
+		if (core_firmware->isCancel) {
+			ret = -ECANCELED;
+			goto out;
+		}
+
+		send = valid;
+		if (send) {
+			ret = do_program_flash(addr, buf[cur]);
+			if (ret < 0)
+				goto out;
+			bytes += page;
+		}
+
+		if (addr + page < start + len)
+			valid = flash_page_stage(addr + page, pfw, buf[cur ^ 1]);
+
+		if (send) {
+			ret = core_flash_poll_busy(TIMEOUT_PROGRAM);
+			if (ret < 0) {
+				ipio_err("Page 0x%x is still busy\n", addr);
+				goto out;
+			}
+		}
+
+		cur ^= 1;
+	}
+
+	return bytes;
 
 out:
 	return ret;
@@ -911,7 +1095,8 @@ out:
 
 static int flash_program(u8* pfw)
 {
-	uint32_t i, j, ret = 0 , times, len;
+	uint32_t i, times, len;
+	int ret = 0, bytes = 0;
 
 	for (i = 0; i < ARRAY_SIZE(fbi); i++) {
 
@@ -921,21 +1106,21 @@ static int flash_program(u8* pfw)
 		len = (fbi[i].end - fbi[i].start) + 1;
 		times = (len -1 + flashtab->program_page) / flashtab->program_page;
 		ipio_debug(DEBUG_FIRMWARE, "Block[%d] program start 0x%x to end 0x%x times%d\n", i, fbi[i].start, fbi[i].end, times);
-		j = fbi[i].start;
-		do {
-			ret = do_program_flash(j, pfw);
-			j += flashtab->program_page;
-			if (ret < 0)
-				goto out;
-		} while(--times > 0);
 
+		ret = flash_program_range(fbi[i].start, times * flashtab->program_page, pfw);
+		if (ret < 0)
+			goto out;
+		bytes += ret;
 	}
 
+	return bytes;
+
 out:
 	return ret;
 }
 
-static uint32_t calc_crc32(uint32_t start_addr, uint32_t len, uint8_t *data)
+/* Bitwise reference, kept to cross check the table driven version */
+static uint32_t calc_crc32_bitwise(uint32_t start_addr, uint32_t len, uint8_t *data)
 {
 	uint32_t i, j;
 	uint32_t CRC_POLY = 0x04C11DB7;
@@ -956,6 +1141,60 @@ static uint32_t calc_crc32(uint32_t start_addr, uint32_t len, uint8_t *data)
 	return ReturnCRC;
 }
 
+/*
+ * Same as the IC's DMA CRC: poly 0x04C11DB7, MSB first, init 0xFFFFFFFF
+ * and no final xor, which is exactly what crc32_be() computes.
+ */
+static uint32_t calc_crc32(uint32_t start_addr, uint32_t len, uint8_t *data)
+{
+	return crc32_be(0xFFFFFFFF, data + start_addr, len);
+}
+
+static void crc_bench_run(char *name, uint8_t *data, uint32_t len)
+{
+	uint32_t crc_tb = 0, crc_bw = 0;
+	s64 t_tb = 0, t_bw = 0;
+	ktime_t start;
+
+	start = ktime_get();
+	crc_tb = calc_crc32(0, len, data);
+	t_tb = ktime_us_delta(ktime_get(), start);
+
+	start = ktime_get();
+	crc_bw = calc_crc32_bitwise(0, len, data);
+	t_bw = ktime_us_delta(ktime_get(), start);
+
+	/* bytes per us equals MB/s */
+	t_tb = (t_tb > 0) ? t_tb : 1;
+	t_bw = (t_bw > 0) ? t_bw : 1;
+
+	ipio_info("%s: %d bytes, table crc = 0x%x (%lld us, %lld MB/s), bitwise crc = 0x%x (%lld us, %lld MB/s), %s\n",
+		name, len, crc_tb, t_tb, div_s64((s64)len, t_tb), crc_bw, t_bw, div_s64((s64)len, t_bw),
+		(crc_tb == crc_bw) ? "match" : "MISMATCH");
+}
+
+/* Compare the table driven crc with the bitwise one and report their throughput */
+void core_firmware_crc_bench(void)
+{
+	uint8_t *buf = NULL;
+	uint32_t len = MAX_HEX_FILE_SIZE;
+
+	buf = vmalloc(len);
+	if (ERR_ALLOC_MEM(buf)) {
+		ipio_err("Failed to allocate crc bench buffer\n");
+		return;
+	}
+
+	get_random_bytes(buf, len);
+	crc_bench_run("random", buf, len);
+	crc_bench_run("random (odd length)", buf + 1, len - 7);
+
+	crc_bench_run("built-in image", ILI_FW_IMAGE, ILI_FW_IMAGE_LEN);
+
+	ipio_vfree((void **)&buf);
+}
+EXPORT_SYMBOL(core_firmware_crc_bench);
+
 static void calc_verify_data(uint32_t sa, uint32_t len, uint32_t *check, u8 *pfw)
 {
 	uint32_t i = 0;
@@ -1006,9 +1245,302 @@ out:
 	return ret;
 }
 
+static bool flash_in_block(uint32_t addr, uint32_t len)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(fbi); i++) {
+		if (fbi[i].end == 0)
+			continue;
+
+		if (addr <= fbi[i].end && addr + len > fbi[i].start)
+			return true;
+	}
+
+	return false;
+}
+
+/* True if every block that overlaps the range already passed its CRC check */
+static bool flash_in_good_block(uint32_t addr, uint32_t len, unsigned long *good)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(fbi); i++) {
+		if (fbi[i].end == 0)
+			continue;
+
+		if (addr <= fbi[i].end && addr + len > fbi[i].start && !test_bit(i, good))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Check each block against the CRC the image carries for it. A block left
+ * intact by an interrupted or failed upgrade is skipped entirely, so the
+ * next attempt picks up at the first bad block. Returns true if all blocks
+ * are intact.
+ */
+static bool flash_block_check(u8 *pfw, unsigned long *good)
+{
+	int i, total = 0, first = -1;
+	uint32_t len, lc = 0, vd = 0;
+
+	bitmap_zero(good, FW_BLOCK_INFO_NUM);
+
+	for (i = 0; i < ARRAY_SIZE(fbi); i++) {
+		if (fbi[i].end == 0)
+			continue;
+
+		total++;
+		len = fbi[i].end - fbi[i].start + 1 - 4;
+		calc_verify_data(fbi[i].start, len, &lc, pfw);
+		vd = tddi_check_data(fbi[i].start, len);
+
+		if (vd == lc)
+			set_bit(i, good);
+		else if (first < 0)
+			first = i;
+	}
+
+	if (first < 0)
+		ipio_info("All %d blocks are intact\n", total);
+	else
+		ipio_info("%d of %d blocks intact, resume at block %d (0x%x)\n",
+			bitmap_weight(good, FW_BLOCK_INFO_NUM), total, first, fbi[first].start);
+
+	return (first < 0);
+}
+
+/*
+ * What a sector holds after a full upgrade: the pages covered by a block
+ * are programmed from pfw and the rest of the sector is left erased.
+ */
+static void flash_sector_image(uint32_t addr, u8 *pfw, u8 *buf)
+{
+	uint32_t j, k, page = flashtab->program_page;
+
+	for (k = 0; k < flashtab->sector; k += page) {
+		if (!flash_in_block(addr + k, page)) {
+			memset(buf + k, 0xFF, page);
+			continue;
+		}
+
+		for (j = 0; j < page; j++) {
+			if (addr + k + j <= core_firmware->end_addr)
+				buf[k + j] = pfw[addr + k + j];
+			else
+				buf[k + j] = 0xFF;
+		}
+	}
+}
+
+/*
+ * Compare every sector the image covers with what the IC reports for the
+ * same range. Sectors that differ are marked dirty, and dirty sectors that
+ * read back as erased are marked blank as well since they only need to be
+ * programmed.
+ */
+static int flash_delta_scan(u8 *pfw, struct flash_delta *fd)
+{
+	int s, changed = 0, total = 0;
+	uint32_t addr, lc = 0, vd = 0, blank = 0;
+	u8 *buf = NULL;
+	ktime_t t = ktime_get();
+
+	fd->nr = DIV_ROUND_UP(core_firmware->end_addr + 1, flashtab->sector);
+	if (flashtab->sector < (4 * K) || fd->nr > DELTA_MAX_SECTOR) {
+		ipio_err("Sector size %d doesn't fit delta upgrade\n", flashtab->sector);
+		return -EINVAL;
+	}
+
+	buf = kmalloc(flashtab->sector, GFP_KERNEL);
+	if (ERR_ALLOC_MEM(buf)) {
+		ipio_err("Failed to allocate sector buffer\n");
+		return -ENOMEM;
+	}
+
+	memset(buf, 0xFF, flashtab->sector);
+	calc_verify_data(0, flashtab->sector, &blank, buf);
+
+	bitmap_zero(fd->dirty, DELTA_MAX_SECTOR);
+	bitmap_zero(fd->blank, DELTA_MAX_SECTOR);
+
+	flash_block_check(pfw, fd->good);
+
+	for (s = 0; s < fd->nr; s++) {
+		addr = s * flashtab->sector;
+		if (!flash_in_block(addr, flashtab->sector))
+			continue;
+
+		if (flash_in_good_block(addr, flashtab->sector, fd->good))
+			continue;
+
+		total++;
+		flash_sector_image(addr, pfw, buf);
+		calc_verify_data(0, flashtab->sector, &lc, buf);
+		vd = tddi_check_data(addr, flashtab->sector);
+
+		ipio_debug(DEBUG_FIRMWARE, "Sector 0x%x: flash = %x, image = %x\n", addr, vd, lc);
+
+		if (vd == lc)
+			continue;
+
+		set_bit(s, fd->dirty);
+		if (vd == blank)
+			set_bit(s, fd->blank);
+		changed++;
+	}
+
+	ipio_info("Delta upgrade: %d of %d scanned sectors changed, scan %lld ms\n",
+		changed, total, ktime_to_ms(ktime_sub(ktime_get(), t)));
+
+	ipio_kfree((void **)&buf);
+	return 0;
+}
+
+static int flash_erase_cost(uint32_t size)
+{
+	if (size == flashtab->block)
+		return ERASE_COST_BLOCK;
+	if (size == flashtab->half_block)
+		return ERASE_COST_HALF_BLOCK;
+	return ERASE_COST_SECTOR;
+}
+
+/*
+ * Plan the erases for the aligned range [s, s + size) and return their
+ * estimated cost. A larger erase is used only when every sector under it
+ * is being rewritten anyway and it is cheaper than erasing the pieces.
+ */
+static int flash_erase_plan(struct flash_delta *fd, int s, uint32_t size)
+{
+	int i, n, step, must = 0, cost = 0, mark = fd->cnt;
+	uint32_t sub;
+	bool whole = true;
+
+	n = size / flashtab->sector;
+	for (i = s; i < s + n; i++) {
+		if (i >= fd->nr || !test_bit(i, fd->dirty))
+			whole = false;
+		else if (!test_bit(i, fd->blank))
+			must++;
+	}
+
+	if (must == 0)
+		return 0;
+
+	if (size == flashtab->sector) {
+		fd->op[fd->cnt].addr = s * flashtab->sector;
+		fd->op[fd->cnt].size = size;
+		fd->cnt++;
+		return flash_erase_cost(size);
+	}
+
+	if (size == flashtab->block && flashtab->half_block > flashtab->sector)
+		sub = flashtab->half_block;
+	else
+		sub = flashtab->sector;
+
+	step = sub / flashtab->sector;
+	for (i = s; i < s + n; i += step)
+		cost += flash_erase_plan(fd, i, sub);
+
+	if (whole && flash_erase_cost(size) < cost) {
+		fd->cnt = mark;
+		fd->op[fd->cnt].addr = s * flashtab->sector;
+		fd->op[fd->cnt].size = size;
+		fd->cnt++;
+		cost = flash_erase_cost(size);
+	}
+
+	return cost;
+}
+
+static int flash_delta_erase(struct flash_delta *fd)
+{
+	int i, s, ret = 0, cost = 0, per_block, blank, must;
+	int nr_block = 0, nr_half = 0, nr_sector = 0;
+
+	per_block = flashtab->block / flashtab->sector;
+	fd->cnt = 0;
+	for (s = 0; s < fd->nr; s += per_block)
+		cost += flash_erase_plan(fd, s, flashtab->block);
+
+	for (i = 0; i < fd->cnt; i++) {
+		if (fd->op[i].size == flashtab->block)
+			nr_block++;
+		else if (fd->op[i].size == flashtab->half_block)
+			nr_half++;
+		else
+			nr_sector++;
+	}
+
+	blank = bitmap_weight(fd->blank, fd->nr);
+	must = bitmap_weight(fd->dirty, fd->nr) - blank;
+	ipio_info("Erase plan: %d x 64K, %d x 32K, %d x 4K, %d blank sectors skipped, est. %d ms (%d ms by sector)\n",
+		nr_block, nr_half, nr_sector, blank, cost, must * ERASE_COST_SECTOR);
+
+	for (i = 0; i < fd->cnt; i++) {
+		if (core_firmware->isCancel) {
+			ret = -ECANCELED;
+			break;
+		}
+
+		ret = do_erase_flash(fd->op[i].addr, fd->op[i].size);
+		if (ret < 0) {
+			ipio_err("Failed to erase 0x%x, size = %d\n", fd->op[i].addr, fd->op[i].size);
+			break;
+		}
+	}
+
+	return ret;
+}
+
+/* Program the dirty sectors, merging adjacent pages into one pipelined run */
+static int flash_delta_write(u8 *pfw, struct flash_delta *fd)
+{
+	int s, ret = 0, bytes = 0;
+	uint32_t k, addr, run_start = 0, run_len = 0;
+
+	for_each_set_bit(s, fd->dirty, fd->nr) {
+		addr = s * flashtab->sector;
+
+		for (k = 0; k <= flashtab->sector; k += flashtab->program_page) {
+			if (k < flashtab->sector && flash_in_block(addr + k, flashtab->program_page)) {
+				if (run_len == 0)
+					run_start = addr + k;
+				run_len += flashtab->program_page;
+				continue;
+			}
+
+			if (run_len == 0)
+				continue;
+
+			ret = flash_program_range(run_start, run_len, pfw);
+			if (ret < 0) {
+				ipio_err("Failed to program 0x%x, len = %d\n", run_start, run_len);
+				goto out;
+			}
+			bytes += ret;
+			run_len = 0;
+		}
+	}
+
+	return bytes;
+
+out:
+	return ret;
+}
+
 static int fw_upgrade_flash(u8 *pfw)
 {
 	int ret = UPDATE_OK;
+	struct flash_delta *fd = NULL;
+	ktime_t t;
+	s64 t_erase = 0, t_prog = 0;
+	DECLARE_BITMAP(good, FW_BLOCK_INFO_NUM);
 
 	ilitek_platform_reset_ctrl(true, SW_RST);
 
@@ -1019,28 +1551,58 @@ static int fw_upgrade_flash(u8 *pfw)
 	}
 
 	/* Check if need to upgrade fw */
-	ret = check_fw_upgrade(pfw);
-	if (ret != NEED_UPDATE)
-		goto out;
+	core_firmware_set_phase(PHASE_CHECK);
+	if (core_firmware->isboot && !core_firmware->isForceCheck && fw_ver_is_current()) {
+		/*
+		 * The version lives in AP, which is programmed first, so an upgrade
+		 * cut off later still reports it. Only skip if every block is intact.
+		 */
+		if (flash_block_check(pfw, good)) {
+			ipio_info("FW ver 0x%x is already running and intact\n", core_firmware->current_fw_cb);
+			ret = NO_NEED_UPDATE;
+			goto out;
+		}
+		ipio_info("FW ver 0x%x matches but flash is damaged, have to update\n",
+			core_firmware->current_fw_cb);
+	} else {
+		ret = check_fw_upgrade(pfw);
+		if (ret != NEED_UPDATE)
+			goto out;
+	}
 
 	/* Disable flash protection from being written */
 	core_flash_enable_protect(false);
 
-	ret = flash_erase();
+	/* Only rewrite the sectors whose content really changes */
+	fd = kzalloc(sizeof(*fd), GFP_KERNEL);
+	if (ERR_ALLOC_MEM(fd) || flash_delta_scan(pfw, fd) < 0) {
+		ipio_info("Upgrade the whole image\n");
+		ipio_kfree((void **)&fd);
+	}
+
+	core_firmware_set_phase(PHASE_ERASE);
+	t = ktime_get();
+	ret = fd ? flash_delta_erase(fd) : flash_erase();
 	if (ret < 0) {
 		ipio_err("Failed to erase flash\n");
 		goto out;
 	}
+	t_erase = ktime_us_delta(ktime_get(), t);
 
-	mdelay(1);
-
-	ret = flash_program(pfw);
+	core_firmware_set_phase(PHASE_PROGRAM);
+	t = ktime_get();
+	ret = fd ? flash_delta_write(pfw, fd) : flash_program(pfw);
 	if (ret < 0) {
 		ipio_err("Failed to program flash\n");
 		goto out;
 	}
+	t_prog = ktime_us_delta(ktime_get(), t);
+
+	ipio_info("Erase %lld us, program %d bytes in %lld us (%lld KB/s)\n", t_erase, ret, t_prog,
+		div_s64((s64)ret * 1000, (t_prog > 0) ? t_prog : 1));
 
 	/* We do have to reset chip in order to move new code from flash to iram. */
+	core_firmware_set_phase(PHASE_VERIFY);
 	ilitek_platform_reset_ctrl(true, SW_RST);
 
 	/* the delay time moving code depends on what the touch IC you're using. */
@@ -1061,17 +1623,41 @@ static int fw_upgrade_flash(u8 *pfw)
 
 out:
 	core_config_ice_mode_disable();
+	ipio_kfree((void **)&fd);
 	return ret;
 }
 
+/*
+ * A reset keeps IRAM as long as the IC stayed powered, so before sending
+ * a block of the cached image again ask the DMA for its crc. Only blocks
+ * that were lost or damaged are downloaded. ICE mode must be enabled.
+ */
+static bool iram_block_is_resident(int i)
+{
+	uint32_t dma;
+	ktime_t t = ktime_get();
+
+	dma = host_download_dma_check(fbi[i].mem_start, fbi[i].len - 4);
+	ipio_debug(DEBUG_FIRMWARE, "%s IRAM crc = %x, image = %x, checked in %lld us\n",
+		fbi[i].name, dma, fbi[i].crc, ktime_us_delta(ktime_get(), t));
+
+	return (dma == fbi[i].crc);
+}
+
 static int fw_upgrade_iram(u8 *pfw)
 {
-	int ret = UPDATE_OK, i;
+	int ret = UPDATE_OK, i, bytes = 0, skip = 0;
 	uint32_t mode, crc, dma;
+	bool resident = false;
 	u8 *fw_ptr = NULL;
+	ktime_t start = ktime_get(), t;
+	s64 t_xfer = 0, t_crc = 0, t_total = 0;
 
 	/* Reset before load AP and MP code*/
-	if (!core_gesture->entry) {
+	if (ipd->isResetPending) {
+		/* reset_ctrl started it and the image was prepared meanwhile */
+		ilitek_platform_reset_wait();
+	} else if (!core_gesture->entry) {
 		if (RST_METHODS == HW_RST_HOST_DOWNLOAD)
 			ilitek_platform_reset_ctrl(true, HW_RST);
 		else
@@ -1091,23 +1677,41 @@ static int fw_upgrade_iram(u8 *pfw)
 	}
 
 	fw_ptr = pfw;
-	if (core_fr->actual_fw_mode == protocol->test_mode) {
-		mode = MP;
-	} else if (core_gesture->entry) {
+	if (core_gesture->entry) {
 		mode = GESTURE;
 		fw_ptr = gestrue_fw;
+	} else if (core_fr->actual_fw_mode == protocol->test_mode) {
+		mode = MP;
 	} else {
 		mode = AP;
 	}
 
+	/* Only an image that was downloaded before can still be there */
+	resident = (pfw != NULL && pfw == core_firmware->fw_cache && mode != GESTURE &&
+			!core_firmware->isForceDownload);
+
 	/* Program data to iram acorrding to each block */
+	core_firmware_set_phase(PHASE_PROGRAM);
 	for (i = 0; i < ARRAY_SIZE(fbi); i++) {
 		if (fbi[i].mode == mode && fbi[i].len != 0) {
+			if (resident && fbi[i].len >= 4 && iram_block_is_resident(i)) {
+				ipio_info("%s code is still in IRAM, skip it\n", fbi[i].name);
+				skip++;
+				continue;
+			}
+
 			ipio_info("Download %s code from hex 0x%x to IRAN 0x%x len = 0x%x\n", fbi[i].name, fbi[i].start, fbi[i].mem_start, fbi[i].len);
+
+			t = ktime_get();
 			write_download(fbi[i].mem_start, fbi[i].len, (fw_ptr + fbi[i].start) , SPI_UPGRADE_LEN);
+			t_xfer += ktime_us_delta(ktime_get(), t);
 
-			crc = calc_crc32(fbi[i].start, fbi[i].len - 4 , fw_ptr);
+			t = ktime_get();
+			crc = fbi[i].crc;
 			dma = host_download_dma_check(fbi[i].mem_start, fbi[i].len - 4);
+			t_crc += ktime_us_delta(ktime_get(), t);
+
+			bytes += fbi[i].len;
 
 			ipio_info("%s CRC is %s (%x) : (%x)\n",fbi[i].name, (crc != dma ? "Invalid !" : "Correct !"), crc, dma);
 
@@ -1116,6 +1720,11 @@ static int fw_upgrade_iram(u8 *pfw)
 		}
 	}
 
+	if (skip > 0 && bytes == 0)
+		core_firmware->iram_skip++;
+	else
+		core_firmware->iram_load++;
+
 out:
 	if (!core_gesture->entry) {
 		/* ice mode code reset */
@@ -1125,12 +1734,23 @@ out:
 
 	core_config_ice_mode_disable();
 	mdelay(10);
+
+	t_total = ktime_us_delta(ktime_get(), start);
+	ipio_info("Host download %d bytes: transfer %lld us (%lld KB/s), dma crc %lld us, total %lld us\n",
+		bytes, t_xfer, div_s64((s64)bytes * 1000, (t_xfer > 0) ? t_xfer : 1), t_crc, t_total);
 	return ret;
 }
 
-static int flash_erase_mode(uint32_t mode)
+/*
+ * After a failed upgrade, erase only the blocks that don't match the image
+ * so the IC won't run half written code, and keep the intact ones for the
+ * next attempt to skip.
+ */
+static int flash_erase_bad_blocks(u8 *pfw)
 {
-	uint32_t i, ret = 0;
+	int ret = 0, i;
+	uint32_t addr;
+	DECLARE_BITMAP(good, FW_BLOCK_INFO_NUM);
 
 	ilitek_platform_reset_ctrl(true, SW_RST);
 
@@ -1141,14 +1761,18 @@ static int flash_erase_mode(uint32_t mode)
 	}
 	core_flash_enable_protect(false);
 
-	if (fbi[mode].end == 0)
-		goto out;
+	flash_block_check(pfw, good);
 
-	ipio_debug(DEBUG_FIRMWARE, "Block[%d] earsing start 0x%x to end 0x%x \n", mode, fbi[mode].start, fbi[mode].end);
-	for(i = fbi[mode].start; i <= fbi[mode].end ; i+= flashtab->sector) {
-		ret = do_erase_flash(i);
-		if (ret < 0)
-			goto out;
+	for (i = 0; i < ARRAY_SIZE(fbi); i++) {
+		if (fbi[i].end == 0 || test_bit(i, good))
+			continue;
+
+		ipio_info("Erase bad block %d, 0x%x to 0x%x\n", i, fbi[i].start, fbi[i].end);
+		for (addr = fbi[i].start; addr <= fbi[i].end; addr += flashtab->sector) {
+			ret = do_erase_flash(addr, flashtab->sector);
+			if (ret < 0)
+				goto out;
+		}
 	}
 
 out:
@@ -1156,11 +1780,70 @@ out:
 	return ret;
 }
 
+static const char * const phase_name[] = {
+	[PHASE_IDLE] = "idle",
+	[PHASE_PARSE] = "parse",
+	[PHASE_CHECK] = "check",
+	[PHASE_ERASE] = "erase",
+	[PHASE_PROGRAM] = "program",
+	[PHASE_VERIFY] = "verify",
+	[PHASE_DONE] = "done",
+	[PHASE_FAIL] = "fail",
+	[PHASE_CANCEL] = "cancel",
+};
+
+const char *core_firmware_phase_name(int phase)
+{
+	if (phase < 0 || phase >= ARRAY_SIZE(phase_name))
+		return "unknown";
+
+	return phase_name[phase];
+}
+EXPORT_SYMBOL(core_firmware_phase_name);
+
+void core_firmware_set_phase(int phase)
+{
+	ipio_debug(DEBUG_FIRMWARE, "Upgrade phase: %s\n", core_firmware_phase_name(phase));
+
+	core_firmware->phase = phase;
+	core_firmware->event++;
+	wake_up_interruptible(&core_firmware->wq);
+}
+EXPORT_SYMBOL(core_firmware_set_phase);
+
+/*
+ * Only an explicit upgrade should call it. The buffer itself is released
+ * by the next parse, so a download running on it isn't pulled out.
+ */
+void core_firmware_cache_invalidate(void)
+{
+	ipio_info("Invalidate the cached fw image\n");
+	core_firmware->isCacheValid = false;
+}
+EXPORT_SYMBOL(core_firmware_cache_invalidate);
+
+void core_firmware_cache_free(void)
+{
+	core_firmware->isCacheValid = false;
+
+	if (core_firmware->fw_cache_bin != NULL) {
+		/* fw_cache points into a container held by the loader */
+		release_firmware(core_firmware->fw_cache_bin);
+		core_firmware->fw_cache_bin = NULL;
+		core_firmware->fw_cache = NULL;
+	} else if (core_firmware->fw_cache == ILI_FW_IMAGE) {
+		core_firmware->fw_cache = NULL;
+	} else {
+		ipio_vfree((void **)&core_firmware->fw_cache);
+	}
+}
+EXPORT_SYMBOL(core_firmware_cache_free);
+
 int core_firmware_upgrade(int upgrade_type, int file_type, int open_file_method)
 {
 	u8 *pfw = NULL;
 	int ret  = UPDATE_OK, retry, rel = 0;
-	bool power = false, esd = false;
+	bool power = false, esd = false, isBin = false, isBuiltin = false, keep = false;
 
 	retry = core_firmware->retry_times;
 
@@ -1179,6 +1862,48 @@ int core_firmware_upgrade(int upgrade_type, int file_type, int open_file_method)
 		cancel_delayed_work_sync(&ipd->check_esd_status_work);
 	}
 
+	if (upgrade_type == UPGRADE_IRAM && core_gesture->entry) {
+		/*
+		 * Gesture download only needs gestrue_fw, which was kept from the
+		 * last parse, so neither the image nor the cached AP is touched.
+		 */
+		if (!core_gesture->code_valid) {
+			ipio_err("Gesture code hasn't been parsed yet\n");
+			ret = UPDATE_FAIL;
+			goto out;
+		}
+		goto upgrade;
+	}
+
+	if (upgrade_type == UPGRADE_IRAM && core_firmware->isCacheValid) {
+		/* fbi[] is still the one parsed along with the cached image */
+		ipio_debug(DEBUG_FIRMWARE, "Use the cached fw image, skip parsing\n");
+		pfw = core_firmware->fw_cache;
+		goto upgrade;
+	}
+
+	/* Going to parse a file again, so the cached one is stale anyway */
+	core_firmware_cache_free();
+
+	if (!core_gesture->entry && file_type == HEX_FILE && open_file_method == REQUEST_FIRMWARE) {
+		pfw = fw_bin_get();
+		if (pfw != NULL) {
+			isBin = true;
+			fw_upgrade_info_setting(pfw, upgrade_type);
+			goto upgrade;
+		}
+	}
+
+	if (!core_gesture->entry && file_type == ILI_FILE) {
+		core_firmware_set_phase(PHASE_PARSE);
+		pfw = ili_file_get();
+		if (pfw != NULL) {
+			isBuiltin = true;
+			fw_upgrade_info_setting(pfw, upgrade_type);
+			goto upgrade;
+		}
+	}
+
 	pfw = vmalloc(UPGRADE_BUFFER_SIZE * sizeof(uint8_t));
 	if (ERR_ALLOC_MEM(pfw)) {
 		ipio_err("Failed to allocate pfw memory, %ld\n", PTR_ERR(pfw));
@@ -1189,12 +1914,17 @@ int core_firmware_upgrade(int upgrade_type, int file_type, int open_file_method)
 
 	if (!core_gesture->entry) {
 		/* Parse ili/hex file */
-		if (fw_upgrade_file_convert(file_type, pfw, open_file_method) < 0)
+		core_firmware_set_phase(PHASE_PARSE);
+		if (fw_upgrade_file_convert(file_type, pfw, open_file_method) < 0) {
+			ret = UPDATE_FAIL;
 			goto out;
+		}
 
 		fw_upgrade_info_setting(pfw, upgrade_type);
 	}
 
+upgrade:
+
 	do {
 		switch(upgrade_type) {
 			case UPGRADE_FLASH:
@@ -1208,16 +1938,20 @@ int core_firmware_upgrade(int upgrade_type, int file_type, int open_file_method)
 				ret = UPDATE_FAIL;
 				break;
 		}
-		if (ret >= 0)
+		if (ret >= 0 || core_firmware->isCancel)
 			break;
 
 		ipio_info("Upgrade firmware retry Fail %d times !\n", (core_firmware->retry_times - retry + 1));
 	} while(--retry > 0);
 
 	if (ret < 0) {
-		ipio_info("Upgrade firmware failed, erase %s \n", ((ret == UPGRADE_FLASH) ? "FLASH" : "IRAM"));
+		/* A cancelled upgrade leaves the flash as it is, to be resumed */
+		if (upgrade_type == UPGRADE_FLASH && core_firmware->isCancel)
+			goto out;
+
+		ipio_info("Upgrade firmware failed, erase %s \n", ((upgrade_type == UPGRADE_FLASH) ? "bad blocks" : "IRAM"));
 		if (upgrade_type == UPGRADE_FLASH)
-			rel = flash_erase_mode(AP);
+			rel = flash_erase_bad_blocks(pfw);
 		else
 			rel = ilitek_platform_reset_ctrl(true, HW_RST);
 
@@ -1236,8 +1970,7 @@ int core_firmware_upgrade(int upgrade_type, int file_type, int open_file_method)
 out:
 	if (power) {
 		ipd->isEnablePollCheckPower = true;
-		queue_delayed_work(ipd->check_power_status_queue,
-			&ipd->check_power_status_work, ipd->work_delay);
+		ilitek_platform_plug_refresh();
 	}
 	if (esd) {
 		ipd->isEnablePollCheckEsd = true;
@@ -1246,7 +1979,41 @@ out:
 	}
 
 	core_firmware->isUpgrading = false;
-	ipio_vfree((void **)&pfw);
+
+	if (ret < 0) {
+		core_firmware->update_status = ret;
+		core_firmware_set_phase(core_firmware->isCancel ? PHASE_CANCEL : PHASE_FAIL);
+	} else {
+		core_firmware->update_status = 100;
+		core_firmware_set_phase(PHASE_DONE);
+	}
+	core_firmware->isCancel = false;
+
+	if (pfw != core_firmware->fw_cache) {
+		/* Keep the image once it has been loaded into iram successfully */
+		keep = (upgrade_type == UPGRADE_IRAM && ret >= 0 && !core_gesture->entry);
+		if (isBin) {
+			/* pfw lives in the loader's buffer, hold on to that instead */
+			if (keep && core_firmware->fw_bin != NULL) {
+				core_firmware->fw_cache = pfw;
+				core_firmware->fw_cache_bin = core_firmware->fw_bin;
+				core_firmware->fw_bin = NULL;
+				core_firmware->isCacheValid = true;
+			}
+		} else if (keep) {
+			core_firmware->fw_cache = pfw;
+			core_firmware->isCacheValid = true;
+		} else if (!isBuiltin) {
+			ipio_vfree((void **)&pfw);
+		}
+	}
+
+	if (core_firmware->fw_bin != NULL) {
+		if (core_firmware->fw_req == core_firmware->fw_bin)
+			core_firmware->fw_req = NULL;
+		release_firmware(core_firmware->fw_bin);
+		core_firmware->fw_bin = NULL;
+	}
 
 	ipio_info("Upgrade firmware %s !\n", ((ret < 0) ? "failed" : "succed"));
 	return ret;
@@ -1264,12 +2031,24 @@ int core_firmware_init(void)
 
 	core_firmware->hex_tag = 0;
 	core_firmware->isboot = false;
+	core_firmware->fw_cache = NULL;
+	core_firmware->isCacheValid = false;
+	core_firmware->fw_req = NULL;
+	core_firmware->fw_bin = NULL;
+	core_firmware->fw_cache_bin = NULL;
+	core_firmware->phase = PHASE_IDLE;
+	core_firmware->isCancel = false;
+	init_waitqueue_head(&core_firmware->wq);
 
 	for (j = 0; j < 4; j++)
 		core_firmware->new_fw_ver[i] = 0x0;
 
 	core_firmware->max_count = 0x1FFFF;
 	core_firmware->isCRC = true;
+	core_firmware->isForceCheck = false;
+	core_firmware->isForceDownload = false;
+	core_firmware->iram_skip = 0;
+	core_firmware->iram_load = 0;
 	core_firmware->retry_times = 3;
 	core_firmware->delay_after_upgrade = 200;
 
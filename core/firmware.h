@@ -43,7 +43,28 @@ struct core_firmware_data {
 	bool isUpgrading;
 	bool isCRC;
 	bool isboot;
+	bool isForceCheck;
+	bool isForceDownload;
 	int hex_tag;
+
+	/* Parsed image and fbi[] kept for IRAM reloads */
+	u8 *fw_cache;
+	bool isCacheValid;
+	uint32_t iram_skip;
+	uint32_t iram_load;
+
+	/* Image already handed over by request_firmware_nowait at boot */
+	const struct firmware *fw_req;
+
+	/* Loader buffers owned by the upgrade and by fw_cache */
+	const struct firmware *fw_bin;
+	const struct firmware *fw_cache_bin;
+
+	/* Progress reported through the fw_upgrade node */
+	int phase;
+	uint32_t event;
+	bool isCancel;
+	wait_queue_head_t wq;
 };
 
 struct flash_block_info {
@@ -54,6 +75,7 @@ struct flash_block_info {
 	uint32_t mem_start;
 	uint32_t fix_mem_start;
 	uint8_t mode;
+	uint32_t crc;
 };
 
 enum upgrade_target {
@@ -66,6 +88,18 @@ enum upgrade_type {
 	UPGRADE_IRAM
 };
 
+enum upgrade_phase {
+	PHASE_IDLE = 0,
+	PHASE_PARSE,
+	PHASE_CHECK,
+	PHASE_ERASE,
+	PHASE_PROGRAM,
+	PHASE_VERIFY,
+	PHASE_DONE,
+	PHASE_FAIL,
+	PHASE_CANCEL
+};
+
 /* FW block number */
 enum block_num {
 	AP = 1,
@@ -91,7 +125,12 @@ enum {
 
 extern struct core_firmware_data *core_firmware;
 extern int core_firmware_upgrade(int type, int file_type, int open_file_method);
+extern void core_firmware_cache_invalidate(void);
+extern void core_firmware_cache_free(void);
+extern void core_firmware_crc_bench(void);
+extern void core_firmware_set_phase(int phase);
+extern const char *core_firmware_phase_name(int phase);
 extern int core_firmware_init(void);
-extern int core_dump_flash(void);
+extern int core_dump_flash(uint8_t **data, uint32_t *len);
 
 #endif /* __FIRMWARE_H */
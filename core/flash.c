@@ -32,13 +32,13 @@
  * would be different according to the vendors.
  */
 struct flash_table ft[] = {
-	{0xEF, 0x6011, (128 * K), 256, (4 * K), (64 * K)},	/*  W25Q10EW  */
-	{0xEF, 0x6012, (256 * K), 256, (4 * K), (64 * K)},	/*  W25Q20EW  */
-	{0xC8, 0x6012, (256 * K), 256, (4 * K), (64 * K)},	/*  GD25LQ20B */
-	{0xC8, 0x6013, (512 * K), 256, (4 * K), (64 * K)},	/*  GD25LQ40 */
-	{0x85, 0x6013, (4 * M), 256, (4 * K), (64 * K)},
-	{0xC2, 0x2812, (256 * K), 256, (4 * K), (64 * K)},
-	{0x1C, 0x3812, (256 * K), 256, (4 * K), (64 * K)},
+	{0xEF, 0x6011, (128 * K), 256, (4 * K), (64 * K), (32 * K)},	/*  W25Q10EW  */
+	{0xEF, 0x6012, (256 * K), 256, (4 * K), (64 * K), (32 * K)},	/*  W25Q20EW  */
+	{0xC8, 0x6012, (256 * K), 256, (4 * K), (64 * K), (32 * K)},	/*  GD25LQ20B */
+	{0xC8, 0x6013, (512 * K), 256, (4 * K), (64 * K), (32 * K)},	/*  GD25LQ40 */
+	{0x85, 0x6013, (4 * M), 256, (4 * K), (64 * K), (32 * K)},
+	{0xC2, 0x2812, (256 * K), 256, (4 * K), (64 * K), (32 * K)},
+	{0x1C, 0x3812, (256 * K), 256, (4 * K), (64 * K), 0},
 };
 
 struct flash_table *flashtab = NULL;
@@ -89,24 +89,112 @@ void core_flash_dma_write(uint32_t start, uint32_t end, uint32_t len)
 	core_config_ice_mode_write(FLASH3_reg_rcv_cnt, len, 4);	/* Write Length */
 }
 
-int core_flash_poll_busy(int timer)
+/*
+ * Move len bytes of flash into iram with DMA channel 0, the same way
+ * MP code is moved, but wait for the DMA done flag instead of a fixed delay.
+ */
+static int flash_dma_to_iram(uint32_t dest, uint32_t start, uint32_t len)
+{
+	int timer = 100;
+
+	core_config_ice_mode_bit_mask(DMA48_ADDR, DMA48_reg_dma_ch0_start_clear, (1 << 25));
+
+	/* src1 is the flash rx data register */
+	core_config_ice_mode_write(DMA49_reg_dma_ch0_src1_addr, FLASH4_reg_rcv_data, 4);
+	core_config_ice_mode_write(DMA50_reg_dma_ch0_src1_step_inc, 0x00, 1);
+	core_config_ice_mode_bit_mask(DMA50_ADDR, DMA50_reg_dma_ch0_src1_format, (0 << 24));
+	core_config_ice_mode_bit_mask(DMA50_ADDR, DMA50_reg_dma_ch0_src1_en, (1 << 31));
+	core_config_ice_mode_bit_mask(DMA52_ADDR, DMA52_reg_dma_ch0_src2_en, (0 << 31));
+
+	core_config_ice_mode_write(DMA53_reg_dma_ch0_dest_addr, dest, 3);
+	core_config_ice_mode_write(DMA54_reg_dma_ch0_dest_step_inc, 0x01, 1);
+	core_config_ice_mode_bit_mask(DMA54_ADDR, DMA54_reg_dma_ch0_dest_format, (0 << 24));
+	core_config_ice_mode_bit_mask(DMA54_ADDR, DMA54_reg_dma_ch0_dest_en, (1 << 31));
+
+	core_config_ice_mode_write(DMA55_reg_dma_ch0_trafer_counts, len, 4);
+	core_config_ice_mode_bit_mask(DMA55_ADDR, DMA55_reg_dma_ch0_trafer_mode, (0 << 24));
+	core_config_ice_mode_bit_mask(INTR33_ADDR, INTR33_reg_dma_ch0_int_en, (1 << 17));
+	core_config_ice_mode_bit_mask(DMA48_ADDR, DMA48_reg_dma_ch0_trigger_sel, (1 << 16));
+
+	core_flash_dma_write(start, start + len, len);
+
+	core_config_ice_mode_bit_mask(INTR1_ADDR, INTR1_reg_flash_int_flag, (1 << 25));
+	core_config_ice_mode_bit_mask(INTR1_ADDR, INTR1_reg_dma_ch0_int_flag, (1 << 17));
+	core_config_ice_mode_bit_mask(0x041013, BIT(0), 1);
+
+	/* DMA Trigger */
+	core_config_ice_mode_write(FLASH4_reg_rcv_data, 0xFF, 1);
+
+	while (timer > 0) {
+		if (core_config_ice_mode_read(INTR1_ADDR) & INTR1_reg_dma_ch0_int_flag)
+			break;
+		usleep_range(500, 600);
+		timer--;
+	}
+
+	/* CS High */
+	core_config_ice_mode_write(FLASH0_reg_flash_csb, 0x1, 1);
+	core_config_ice_mode_bit_mask(DMA48_ADDR, DMA48_reg_dma_ch0_trigger_sel, (0 << 16));
+	core_flash_dma_clear();
+
+	if (timer <= 0) {
+		ipio_err("Flash DMA to iram timeout, start = 0x%x, len = 0x%x\n", start, len);
+		return -ETIME;
+	}
+
+	return 0;
+}
+
+/*
+ * Read flash in bulk: DMA a chunk into iram and fetch it with one burst
+ * read instead of one ICE round trip per byte. ICE mode has to be enabled
+ * with MCU stopped, and iram gets overwritten, so fw must be reloaded
+ * by the caller once it's done.
+ */
+int core_flash_dma_read(uint32_t start, uint8_t *data, uint32_t len)
 {
 	int ret = 0;
+	uint32_t i, size;
+
+	for (i = 0; i < len; i += size) {
+		size = min_t(uint32_t, len - i, FLASH_DMA_READ_LEN);
+
+		ret = flash_dma_to_iram(FLASH_DMA_IRAM_ADDR, start + i, size);
+		if (ret < 0)
+			break;
+
+		ret = core_config_ice_mode_read_burst(FLASH_DMA_IRAM_ADDR, data + i, size);
+		if (ret < 0)
+			break;
+	}
+
+	return ret;
+}
+EXPORT_SYMBOL(core_flash_dma_read);
+
+/*
+ * Wait for WIP/WEL to clear, giving up after timer ms. The sleep between
+ * reads starts short so a page program is caught as soon as it is done and
+ * grows for the long erases.
+ */
+int core_flash_poll_busy(int timer)
+{
+	int ret = 0, delay = FLASH_POLL_MIN_US;
+	ktime_t end = ktime_add_ms(ktime_get(), timer);
 
 	core_config_ice_mode_write(0x041000, 0x0, 1);	/* CS low */
 	core_config_ice_mode_write(0x041004, 0x66aa55, 3);	/* Key */
 
 	core_config_ice_mode_write(0x041008, 0x5, 1);
-	while (timer > 0) {
+	do {
 		core_config_ice_mode_write(0x041008, 0xFF, 1);
 
-		mdelay(1);
-
 		if ((core_config_read_write_onebyte(0x041010) & 0x03) == 0x00)
 			goto out;
 
-		timer--;
-	}
+		usleep_range(delay, delay + (delay >> 1));
+		delay = min(delay << 1, FLASH_POLL_MAX_US);
+	} while (ktime_before(ktime_get(), end));
 
 	ipio_err("Polling busy Time out !\n");
 	ret = -1;
@@ -202,6 +290,7 @@ void core_flash_init(uint16_t mid, uint16_t did)
 			flashtab->program_page = ft[i].program_page;
 			flashtab->sector = ft[i].sector;
 			flashtab->block = ft[i].block;
+			flashtab->half_block = ft[i].half_block;
 			break;
 		}
 	}
@@ -214,11 +303,13 @@ void core_flash_init(uint16_t mid, uint16_t did)
 		flashtab->program_page = 256;
 		flashtab->sector = (4 * K);
 		flashtab->block = (64 * K);
+		flashtab->half_block = 0;
 	}
 
 	ipio_info("Max Memory size = %d\n", flashtab->mem_size);
 	ipio_info("Per program page = %d\n", flashtab->program_page);
 	ipio_info("Sector size = %d\n", flashtab->sector);
 	ipio_info("Block size = %d\n", flashtab->block);
+	ipio_info("Half block size = %d\n", flashtab->half_block);
 }
 EXPORT_SYMBOL(core_flash_init);
\ No newline at end of file
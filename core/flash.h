@@ -191,12 +191,22 @@ struct flash_table {
 	int program_page;
 	int sector;
 	int block;
+	int half_block;	/* 32K erase (0x52), 0 if not supported */
 };
 
 extern struct flash_table *flashtab;
 
+/* Sleep between two status reads in core_flash_poll_busy */
+#define FLASH_POLL_MIN_US		50
+#define FLASH_POLL_MAX_US		2000
+
+/* iram used as a bounce buffer for bulk flash reads */
+#define FLASH_DMA_IRAM_ADDR		0x0
+#define FLASH_DMA_READ_LEN		(16 * K)
+
 extern void core_flash_dma_clear(void);
 extern void core_flash_dma_write(uint32_t start, uint32_t end, uint32_t len);
+extern int core_flash_dma_read(uint32_t start, uint8_t *data, uint32_t len);
 extern int core_flash_poll_busy(int timer);
 extern int core_flash_write_enable(void);
 extern void core_flash_enable_protect(bool status);
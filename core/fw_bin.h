@@ -0,0 +1,66 @@
+/*
+ * ILITEK Touch IC driver
+ *
+ * Copyright (C) 2011 ILI Technology Corporation.
+ *
+ * Author: Dicky Chiang <dicky_chiang@ilitek.com>
+ * Based on TDD v7.0 implemented by Mstar & ILITEK
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef __FW_BIN_H
+#define __FW_BIN_H
+
+/*
+ * Pre-converted firmware container, written by tools/ili_fw_pack.c and
+ * shared with it, so only fixed width types are used here.
+ *
+ * All fields are little endian. The payload follows the header and is the
+ * flat image from address 0, padded with 0xFF to payload_len, so the driver
+ * uses it in place as pfw. CRCs are the same crc32 the IC computes
+ * (poly 0x04C11DB7, init 0xFFFFFFFF, no reflection, no final xor).
+ */
+#define ILI_FW_BIN_MAGIC		0x42494C49	/* "ILIB" */
+#define ILI_FW_BIN_VERSION		1
+#define ILI_FW_BIN_BLOCKS		7	/* FW_BLOCK_INFO_NUM */
+#define ILI_FW_BIN_NO_MEM		0xFFFFFFFF
+#define ILI_FW_BIN_PAYLOAD_LEN		(160 * 1024)	/* UPGRADE_BUFFER_SIZE */
+#define ILI_FW_BIN_VER_ADDR		0xFFE0		/* FW_VER_ADDR */
+
+struct ili_fw_bin_block {
+	uint32_t start;
+	uint32_t end;			/* inclusive, 0 if the block is unused */
+	uint32_t fix_mem_start;		/* ILI_FW_BIN_NO_MEM if none */
+	uint32_t crc;			/* crc32 of start .. end - 4 */
+};
+
+struct ili_fw_bin_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t header_len;		/* offset of the payload */
+	uint32_t fw_ver;
+	uint32_t hex_tag;
+	uint32_t block_number;
+	uint32_t start_addr;
+	uint32_t end_addr;
+	uint32_t payload_len;
+	uint32_t payload_crc;
+	struct ili_fw_bin_block block[ILI_FW_BIN_BLOCKS];
+	uint32_t header_crc;		/* crc32 of everything above */
+};
+
+#endif /* __FW_BIN_H */
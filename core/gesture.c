@@ -113,8 +113,9 @@ EXPORT_SYMBOL(core_esd_gesture);
 #ifdef HOST_DOWNLOAD
 int core_gesture_load_code(void)
 {
-	int i = 0, ret = 0, retry = 0;
+	int ret = 0, retry = 0, delay = GESTURE_READY_POLL_MIN_US;
 	uint8_t temp[64] = {0};
+	ktime_t start = ktime_get(), deadline, t;
 
 	core_gesture->entry = true;
 	retry = core_firmware->retry_times;
@@ -137,7 +138,9 @@ int core_gesture_load_code(void)
 	if (ret < 0)
 		ipio_err("Failed to switch gesture mode\n");
 
-	for (i = 0; i < 20; i++) {
+	/* Sleep between polls and stop as soon as fw says it's ready */
+	deadline = ktime_add_ms(start, GESTURE_READY_TIMEOUT);
+	while (1) {
 		/* Prepare Check Ready */
 		temp[0] = 0xF6;
 		temp[1] = 0x0A;
@@ -146,7 +149,8 @@ int core_gesture_load_code(void)
 			ipio_err("write 0xF6,0xA,0x05 command error\n");
 		}
 
-		mdelay(i * 50);
+		usleep_range(delay, delay + delay / 2);
+		delay = min(delay * 2, GESTURE_READY_POLL_MAX_US);
 
 		/* Check ready for load code*/
 		temp[0] = 0x01;
@@ -162,15 +166,26 @@ int core_gesture_load_code(void)
 			ipio_info("check fw ready\n");
 			break;
 		}
+
+		if (ktime_after(ktime_get(), deadline))
+			break;
 	}
 
 	if (temp[0] != 0x91)
 		ipio_err("FW is busy, error\n");
 
+	t = ktime_get();
+	core_gesture->ready_ms = ktime_to_ms(ktime_sub(t, start));
+
+	/* Only gestrue_fw is downloaded, no file is parsed here */
 	ret = core_firmware_upgrade(UPGRADE_IRAM, HEX_FILE, OPEN_FW_METHOD);
 	if (ret < 0)
 		ipio_err("Gesture load code failed \n");
 
+	core_gesture->load_ms = ktime_to_ms(ktime_sub(ktime_get(), t));
+	ipio_info("Gesture code loaded, ready wait %lld ms, download %lld ms\n",
+		core_gesture->ready_ms, core_gesture->load_ms);
+
 	/* FW star run gestrue code cmd*/
 	temp[0] = 0x01;
 	temp[1] = 0x0A;
@@ -32,6 +32,11 @@
 #define GESTURE_INFO_MODE            1
 #define GESTURE_MODE GESTURE_NORMAL_MODE
 
+/* Wait for fw to be ready for the gesture code, in ms */
+#define GESTURE_READY_TIMEOUT        1000
+#define GESTURE_READY_POLL_MIN_US    1000
+#define GESTURE_READY_POLL_MAX_US    20000
+
 /* The example for the gesture virtual keys */
 #define GESTURE_DOUBLECLICK			    0x58
 #define GESTURE_UP						0x60
@@ -80,6 +85,11 @@ struct core_gesture_data {
     uint32_t ap_length;
     uint32_t area_section;
     bool suspend;
+    bool code_valid; /* gestrue_fw holds the code parsed along with the AP */
+    /* last gesture suspend, in ms */
+    s64 suspend_ms;
+    s64 ready_ms;
+    s64 load_ms;
 };
 
 extern struct core_gesture_data *core_gesture;
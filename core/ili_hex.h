@@ -0,0 +1,190 @@
+/*
+ * ILITEK Touch IC driver
+ *
+ * Copyright (C) 2011 ILI Technology Corporation.
+ *
+ * Author: Dicky Chiang <dicky_chiang@ilitek.com>
+ * Based on TDD v7.0 implemented by Mstar & ILITEK
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef __ILI_HEX_H
+#define __ILI_HEX_H
+
+/*
+ * Intel HEX decoder shared by the driver and the host tools, so the same
+ * code that runs in the kernel is tested on the host by tools/ili_hex_test.c.
+ * Only fixed width types and memcpy are used here.
+ *
+ * Every record is checksum validated, 00/01/02/04 are handled as the spec
+ * says, 03/05 carry nothing to load, and AE/AF/B0 are ILITEK's block info
+ * records.
+ */
+#define ILI_HEX_BLOCKS		7	/* FW_BLOCK_INFO_NUM */
+#define ILI_HEX_NO_MEM		0xFFFFFFFF
+
+#define ILI_HEX_TAG_AE		0xAE
+#define ILI_HEX_TAG_AF		0xAF
+#define ILI_HEX_TAG_B0		0xB0
+
+#define ILI_HEX_EFORMAT		-1
+#define ILI_HEX_ECHECKSUM	-2
+#define ILI_HEX_ERANGE		-3
+
+struct ili_hex_block {
+	uint32_t start;
+	uint32_t end;			/* inclusive, 0 if the block is unused */
+	uint32_t fix_mem_start;		/* ILI_HEX_NO_MEM if none */
+};
+
+struct ili_hex_info {
+	uint32_t hex_tag;		/* last of AE/AF seen, 0 if none */
+	uint32_t block_number;
+	uint32_t start_addr;
+	uint32_t end_addr;		/* one past the last data byte */
+	uint32_t err_offset;		/* where decoding stopped on error */
+	struct ili_hex_block block[ILI_HEX_BLOCKS];
+};
+
+/* Value of each ascii hex digit with bit 4 set, 0 for anything else */
+static const uint8_t ili_hex_nibble[256] = {
+	['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13, ['4'] = 0x14,
+	['5'] = 0x15, ['6'] = 0x16, ['7'] = 0x17, ['8'] = 0x18, ['9'] = 0x19,
+	['a'] = 0x1A, ['b'] = 0x1B, ['c'] = 0x1C, ['d'] = 0x1D, ['e'] = 0x1E, ['f'] = 0x1F,
+	['A'] = 0x1A, ['B'] = 0x1B, ['C'] = 0x1C, ['D'] = 0x1D, ['E'] = 0x1E, ['F'] = 0x1F,
+};
+
+static inline int ili_hex_byte(const uint8_t *phex, uint8_t *val)
+{
+	uint8_t hi = ili_hex_nibble[phex[0]];
+	uint8_t lo = ili_hex_nibble[phex[1]];
+
+	if (!(hi & lo & 0x10))
+		return -1;
+
+	*val = ((hi & 0xF) << 4) | (lo & 0xF);
+	return 0;
+}
+
+/*
+ * Decode size bytes of hex text into image, which holds image_len bytes and
+ * is left as it is where no record writes. Returns 0 or an ILI_HEX_E* code,
+ * with info->err_offset pointing past the record that failed.
+ */
+static inline int ili_hex_decode(const uint8_t *phex, uint32_t size, uint8_t *image,
+		uint32_t image_len, struct ili_hex_info *info)
+{
+	uint32_t i = 0, j, num, len, addr, type, base = 0, cnt, start = 0xFFFFFFFF, end = 0;
+	uint8_t rec[5 + 0xFF], sum, *data = &rec[4];
+	int ret = 0;
+
+	memset(info, 0, sizeof(*info));
+
+	while (i < size) {
+		/* Skip line endings or anything else between records */
+		if (phex[i++] != ':')
+			continue;
+
+		if (i + 2 > size || ili_hex_byte(&phex[i], &rec[0]) < 0) {
+			ret = ILI_HEX_EFORMAT;
+			goto out;
+		}
+
+		/* byte count, address, type, data and checksum */
+		len = rec[0];
+		cnt = len + 5;
+		if (i + cnt * 2 > size) {
+			ret = ILI_HEX_EFORMAT;
+			goto out;
+		}
+
+		for (j = 0, sum = 0; j < cnt; j++, i += 2) {
+			if (ili_hex_byte(&phex[i], &rec[j]) < 0) {
+				ret = ILI_HEX_EFORMAT;
+				goto out;
+			}
+			sum += rec[j];
+		}
+
+		if (sum != 0) {
+			ret = ILI_HEX_ECHECKSUM;
+			goto out;
+		}
+
+		addr = (rec[1] << 8) | rec[2];
+		type = rec[3];
+
+		switch (type) {
+		case 0x00:
+			addr += base;
+			if (addr > image_len || len > image_len - addr) {
+				ret = ILI_HEX_ERANGE;
+				goto out;
+			}
+			memcpy(image + addr, data, len);
+			if (addr < start)
+				start = addr;
+			if (addr + len > end)
+				end = addr + len;
+			break;
+		case 0x01:
+			goto out;
+		case 0x02:
+		case 0x04:
+			if (len != 2) {
+				ret = ILI_HEX_EFORMAT;
+				goto out;
+			}
+			base = (data[0] << 8) | data[1];
+			base <<= (type == 0x02) ? 4 : 16;
+			break;
+		case ILI_HEX_TAG_AE:
+		case ILI_HEX_TAG_AF:
+			info->hex_tag = type;
+			num = (type == ILI_HEX_TAG_AF) ? data[6] : info->block_number;
+			if (len < ((type == ILI_HEX_TAG_AF) ? 7 : 6) || num >= ILI_HEX_BLOCKS) {
+				ret = ILI_HEX_EFORMAT;
+				goto out;
+			}
+			info->block[num].start = (data[0] << 16) | (data[1] << 8) | data[2];
+			info->block[num].end = (data[3] << 16) | (data[4] << 8) | data[5];
+			info->block[num].fix_mem_start = ILI_HEX_NO_MEM;
+			info->block_number++;
+			break;
+		case ILI_HEX_TAG_B0:
+			if (info->hex_tag != ILI_HEX_TAG_AF)
+				break;
+			if (len < 4 || data[3] >= ILI_HEX_BLOCKS) {
+				ret = ILI_HEX_EFORMAT;
+				goto out;
+			}
+			info->block[data[3]].fix_mem_start = (data[0] << 16) | (data[1] << 8) | data[2];
+			break;
+		default:
+			/* 03/05 and anything unknown carry nothing to load */
+			break;
+		}
+	}
+
+out:
+	info->start_addr = (start == 0xFFFFFFFF) ? 0 : start;
+	info->end_addr = end;
+	info->err_offset = i;
+	return ret;
+}
+
+#endif /* __ILI_HEX_H */
@@ -1,3 +1,3 @@
-static unsigned char CTPM_FW[] = {
+static const unsigned char CTPM_FW[] = {
 	#include "FW_TDDI_TRUNK_FB.ili"
 };
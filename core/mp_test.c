@@ -609,16 +609,20 @@ static int allnode_key_cdc_data(int index)
 	cmd[1] = tItems[index].cmd;
 	cmd[2] = 0;
 
+	core_config_int_wait_arm();
 	ret = core_write(core_config->slave_i2c_addr, cmd, 3);
 	if (ret < 0) {
 		ipio_err("I2C Write Error while initialising cdc\n");
+		core_config_int_wait_disarm();
 		goto out;
 	}
 
 	mdelay(1);
 
 	/* Check busy */
-	if (core_config_check_cdc_busy(50, 50) < 0) {
+	ret = core_config_check_cdc_busy(50, 50);
+	core_config_int_wait_disarm();
+	if (ret < 0) {
 		ipio_err("Check busy is timout !\n");
 		ret = -1;
 		goto out;
@@ -811,9 +815,13 @@ static int allnode_mutual_cdc_data(int index)
 
 	dump_data(cmd, 8, protocol->cdc_len, 0, "Mutual CDC command");
 
+	if (core_mp->busy_cdc != DELAY_CHECK)
+		core_config_int_wait_arm();
+
 	ret = core_write(core_config->slave_i2c_addr, cmd, protocol->cdc_len);
 	if (ret < 0) {
 		ipio_err("I2C Write Error while initialising cdc\n");
+		core_config_int_wait_disarm();
 		goto out;
 	}
 
@@ -826,6 +834,7 @@ static int allnode_mutual_cdc_data(int index)
 	} else if (core_mp->busy_cdc == DELAY_CHECK) {
 		mdelay(600);
 	}
+	core_config_int_wait_disarm();
 
 	if (ret < 0) {
 		ipio_err("Check busy timeout !\n");
@@ -1225,9 +1234,13 @@ int allnode_open_cdc_data(int mode, int *buf)
 
 	dump_data(cmd, 8, sizeof(cmd), 0, "Open SP command");
 
+	if (core_mp->busy_cdc != DELAY_CHECK)
+		core_config_int_wait_arm();
+
 	ret = core_write(core_config->slave_i2c_addr, cmd, protocol->cdc_len);
 	if (ret < 0) {
 		ipio_err("I2C Write Error while initialising cdc\n");
+		core_config_int_wait_disarm();
 		goto out;
 	}
 
@@ -1240,6 +1253,7 @@ int allnode_open_cdc_data(int mode, int *buf)
 	} else if (core_mp->busy_cdc == DELAY_CHECK) {
 		mdelay(600);
 	}
+	core_config_int_wait_disarm();
 
 	if (ret < 0) {
 		ipio_err("Check busy timeout !\n");
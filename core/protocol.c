@@ -64,6 +64,38 @@ int core_read(uint8_t nSlaveId, uint8_t *pBuf, uint16_t nSize)
 }
 EXPORT_SYMBOL(core_read);
 
+/*
+ * Write a command header followed by its payload. On SPI in ICE mode they
+ * go out as separate transfers of one message, so the payload isn't copied.
+ * Otherwise they're glued into one buffer as core_write() expects.
+ */
+int core_write_sg(uint8_t nSlaveId, uint8_t *head, uint16_t hlen, uint8_t *data, uint16_t dlen)
+{
+	int ret = 0;
+	uint8_t *buf = NULL;
+
+#if (INTERFACE == SPI_INTERFACE) && (TP_PLATFORM != PT_MTK) && (KERNEL_VERSION(4, 0, 0) <= LINUX_VERSION_CODE)
+	/* spi core can only map payloads living in lowmem or vmalloc for dma */
+	if (core_config->icemodeenable && (virt_addr_valid(data) || is_vmalloc_addr(data)))
+		return core_spi_write_sg(head, hlen, data, dlen);
+#endif
+
+	buf = kmalloc(hlen + dlen, GFP_KERNEL);
+	if (ERR_ALLOC_MEM(buf)) {
+		ipio_err("Failed to allocate buf mem\n");
+		return -ENOMEM;
+	}
+
+	memcpy(buf, head, hlen);
+	memcpy(buf + hlen, data, dlen);
+
+	ret = core_write(nSlaveId, buf, hlen + dlen);
+
+	ipio_kfree((void **)&buf);
+	return ret;
+}
+EXPORT_SYMBOL(core_write_sg);
+
 static int hashCode(int key)
 {
 	return key % FUNC_NUM;
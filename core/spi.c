@@ -483,6 +483,48 @@ out:
 }
 EXPORT_SYMBOL(core_spi_write);
 
+/*
+ * Send header and payload as two transfers of one message, so the payload
+ * goes out straight from the caller's buffer without being copied behind
+ * the header first. Only used in ICE mode where no handshake is needed.
+ */
+int core_spi_write_sg(uint8_t *head, uint16_t hlen, uint8_t *data, uint16_t dlen)
+{
+	int ret = 0;
+	struct spi_message message;
+	struct spi_transfer xfer[2];
+
+	if (hlen + 1 > SPI_SG_HEAD_MAXSIZE)
+		return -EINVAL;
+
+	core_spi->sg_head[0] = SPI_WRITE;
+	memcpy(core_spi->sg_head + 1, head, hlen);
+
+	memset(xfer, 0, sizeof(xfer));
+	spi_message_init(&message);
+
+	xfer[0].tx_buf = core_spi->sg_head;
+	xfer[0].len = hlen + 1;
+	spi_message_add_tail(&xfer[0], &message);
+
+	xfer[1].tx_buf = data;
+	xfer[1].len = dlen;
+	spi_message_add_tail(&xfer[1], &message);
+
+	if (spi_sync(core_spi->spi, &message) < 0) {
+		if (atomic_read(&ipd->do_reset)) {
+			/* ignore spi error if doing ic reset */
+			ret = 0;
+		} else {
+			ret = -EIO;
+			ipio_err("spi sg Write Error, ret = %d\n", ret);
+		}
+	}
+
+	return ret;
+}
+EXPORT_SYMBOL(core_spi_write_sg);
+
 int core_spi_read(uint8_t *pBuf, uint16_t nSize)
 {
 	int ret = 0, count = SPI_RETRY;
@@ -621,6 +663,12 @@ int core_spi_init(struct spi_device *spi)
 	ipio_info("name = %s, bus_num = %d,cs = %d, mode = %d, speed = %d\n",spi->modalias,
 	 spi->master->bus_num, spi->chip_select, spi->mode, spi->max_speed_hz);
 
+	core_spi->sg_head = devm_kzalloc(ipd->dev, SPI_SG_HEAD_MAXSIZE, GFP_KERNEL);
+	if (ERR_ALLOC_MEM(core_spi->sg_head)) {
+		ipio_err("Failed to alllocate sg head mem %ld\n", PTR_ERR(core_spi->sg_head));
+		return -ENOMEM;
+	}
+
 	core_spi->spi = spi;
 	return 0;
 }
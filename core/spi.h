@@ -33,12 +33,16 @@
 #define DMA_TRANSFER_MAX_SIZE 1024
 #define SPI_WRITE_BUFF_MAXSIZE (1024 * DMA_TRANSFER_MAX_TIMES + 5)//plus 5 for IC Mode :(Head + Address) 0x82,0x25,Addr_L,Addr_M,Addr_H
 #define SPI_READ_BUFF_MAXSIZE  (1024 * DMA_TRANSFER_MAX_TIMES)
+#define SPI_SG_HEAD_MAXSIZE 8
 
 struct core_spi_data {
 	struct spi_device *spi;
 	int (*spi_write_then_read)(struct spi_device *spi,
 		const void *txbuf, unsigned n_tx,
 		void *rxbuf, unsigned n_rx);
+
+	/* DMA safe buffer for the header of scatter-gather writes */
+	uint8_t *sg_head;
 };
 
 extern struct core_spi_data *core_spi;
@@ -46,6 +50,7 @@ extern struct core_spi_data *core_spi;
 extern void core_spi_speed_up(bool Enable);
 extern int core_spi_write(uint8_t *pBuf, uint16_t nSize);
 extern int core_spi_read(uint8_t *pBuf, uint16_t nSize);
+extern int core_spi_write_sg(uint8_t *head, uint16_t hlen, uint8_t *data, uint16_t dlen);
 extern int core_spi_init(struct spi_device *spi);
 extern void core_spi_remove(void);
 
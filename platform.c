@@ -48,6 +48,10 @@ extern struct tpd_device *tpd;
 
 #define DEVICE_ID	"ILITEK_TDDI"
 
+#define ESD_RESYNC_RETRY	3
+#define ESD_IDLE_BACKOFF_MAX	8
+#define RESET_SETTLE_TIME	100
+
 /* Debug level */
 uint32_t ipio_debug_level = DEBUG_ALL;
 EXPORT_SYMBOL(ipio_debug_level);
@@ -100,6 +104,15 @@ out:
 }
 EXPORT_SYMBOL(ilitek_platform_enable_irq);
 
+/* msleep may oversleep by a jiffy or two, too much for the short edges */
+static void ilitek_platform_sleep_ms(int ms)
+{
+	if (ms < 20)
+		usleep_range(ms * 1000, ms * 1000 + 500);
+	else
+		msleep(ms);
+}
+
 int ilitek_platform_tp_hw_reset(bool isEnable)
 {
 	int ret = 0;
@@ -107,18 +120,18 @@ int ilitek_platform_tp_hw_reset(bool isEnable)
 	if (isEnable) {
 #if (TP_PLATFORM == PT_MTK)
 		tpd_gpio_output(ipd->reset_gpio, 1);
-		mdelay(ipd->delay_time_high);
+		ilitek_platform_sleep_ms(ipd->delay_time_high);
 		tpd_gpio_output(ipd->reset_gpio, 0);
-		mdelay(ipd->delay_time_low);
+		ilitek_platform_sleep_ms(ipd->delay_time_low);
 		tpd_gpio_output(ipd->reset_gpio, 1);
-		mdelay(ipd->edge_delay);
+		ilitek_platform_sleep_ms(ipd->edge_delay);
 #else
 		gpio_direction_output(ipd->reset_gpio, 1);
-		mdelay(ipd->delay_time_high);
+		ilitek_platform_sleep_ms(ipd->delay_time_high);
 		gpio_set_value(ipd->reset_gpio, 0);
-		mdelay(ipd->delay_time_low);
+		ilitek_platform_sleep_ms(ipd->delay_time_low);
 		gpio_set_value(ipd->reset_gpio, 1);
-		mdelay(ipd->edge_delay);
+		ilitek_platform_sleep_ms(ipd->edge_delay);
 #endif /* PT_MTK */
 	} else {
 #if (TP_PLATFORM == PT_MTK)
@@ -203,56 +216,70 @@ static void ilitek_regulator_power_reg(struct ilitek_platform_data *ipd)
 #endif /* REGULATOR_POWER_ON */
 
 #ifdef BATTERY_CHECK
-static void read_power_status(uint8_t *buf)
+static int ilitek_platform_charge_status(void)
 {
-	struct file *f = NULL;
-	mm_segment_t old_fs;
-	ssize_t byte = 0;
-
-	old_fs = get_fs();
-	set_fs(get_ds());
+	struct power_supply *psy = NULL;
+	union power_supply_propval val = { 0 };
+	int ret = 0;
 
-	f = filp_open(POWER_STATUS_PATH, O_RDONLY, 0);
-	if (ERR_ALLOC_MEM(f)) {
-		ipio_err("Failed to open %s\n", POWER_STATUS_PATH);
-		return;
+	psy = power_supply_get_by_name(POWER_SUPPLY_NAME);
+	if (psy == NULL) {
+		ipio_err("Failed to find power supply %s\n", POWER_SUPPLY_NAME);
+		return -ENODEV;
 	}
 
-	f->f_op->llseek(f, 0, SEEK_SET);
-	byte = f->f_op->read(f, buf, 20, &f->f_pos);
-
-	ipio_debug(DEBUG_BATTERY, "Read %d bytes\n", (int)byte);
+#if KERNEL_VERSION(4, 1, 0) <= LINUX_VERSION_CODE
+	ret = power_supply_get_property(psy, POWER_SUPPLY_PROP_STATUS, &val);
+	power_supply_put(psy);
+#else
+	ret = psy->get_property(psy, POWER_SUPPLY_PROP_STATUS, &val);
+#endif
+	if (ret < 0)
+		return ret;
 
-	set_fs(old_fs);
-	filp_close(f, NULL);
+	return val.intval;
 }
 
+/* Tell the IC about the charger only when its state actually flips */
 static void ilitek_platform_vpower_notify(struct work_struct *pWork)
 {
-	uint8_t charge_status[20] = { 0 };
-	static int charge_mode = 0;
-
-	ipio_debug(DEBUG_BATTERY, "isEnableCheckPower = %d\n", ipd->isEnablePollCheckPower);
-	read_power_status(charge_status);
-	ipio_debug(DEBUG_BATTERY, "Batter Status: %s\n", charge_status);
-
-	if (strstr(charge_status, "Charging") != NULL || strstr(charge_status, "Full") != NULL
-	    || strstr(charge_status, "Fully charged") != NULL) {
-		if (charge_mode != 1) {
-			ipio_debug(DEBUG_BATTERY, "Charging mode\n");
-			core_config_plug_ctrl(false);
-			charge_mode = 1;
-		}
+	int status, mode;
+
+	status = ilitek_platform_charge_status();
+	if (status < 0)
+		return;
+
+	ipio_debug(DEBUG_BATTERY, "Battery status: %d\n", status);
+
+	if (status == POWER_SUPPLY_STATUS_CHARGING || status == POWER_SUPPLY_STATUS_FULL)
+		mode = 1;
+	else
+		mode = 2;
+
+	if (mode == ipd->charge_mode)
+		return;
+
+	if (mode == 1) {
+		ipio_debug(DEBUG_BATTERY, "Charging mode\n");
+		core_config_plug_ctrl(false);
 	} else {
-		if (charge_mode != 2) {
-			ipio_debug(DEBUG_BATTERY, "Not charging mode\n");
-			core_config_plug_ctrl(true);
-			charge_mode = 2;
-		}
+		ipio_debug(DEBUG_BATTERY, "Not charging mode\n");
+		core_config_plug_ctrl(true);
 	}
+	ipd->charge_mode = mode;
+}
 
-	if (ipd->isEnablePollCheckPower)
-		queue_delayed_work(ipd->check_power_status_queue, &ipd->check_power_status_work, ipd->work_delay);
+/* Runs in atomic context, so the IC is only touched from the work */
+static int ilitek_platform_power_notifier(struct notifier_block *nb, unsigned long event, void *data)
+{
+	/* Resume sends the state anyway, don't wake a sleeping IC for it */
+	if (event != PSY_EVENT_PROP_CHANGED || !ipd->isEnablePollCheckPower || ipd->isSuspend)
+		return NOTIFY_DONE;
+
+	/* Supplies report in bursts, only look once they settle */
+	mod_delayed_work(ipd->check_power_status_queue, &ipd->check_power_status_work,
+		msecs_to_jiffies(CHARGER_DEBOUNCE_TIME));
+	return NOTIFY_OK;
 }
 #endif /* BATTERY_CHECK */
 
@@ -261,18 +288,47 @@ static void ilitek_platform_esd_recovery(struct work_struct *work)
 {
 	int ret = 0;
 
+	/* The boot upgrade brings the IC up anyway, look again afterwards */
+	if (!completion_done(&ipd->boot_fw_done)) {
+		ipio_info("Boot upgrade in progress, skip ESD recovery\n");
+		goto out;
+	}
+
 	mutex_lock(&ipd->plat_mutex);
-	ret = ilitek_platform_reset_ctrl(true, RST_METHODS);
+	ret = ilitek_platform_esd_recover();
 	mutex_unlock(&ipd->plat_mutex);
+
+	if (ipd->isPowerPending)
+		ilitek_platform_power_update();
+
+	if (ret < 0)
+		ipio_err("ESD recovery failed, ret = %d\n", ret);
+
+out:
+	if (ipd->isEnablePollCheckEsd)
+		queue_delayed_work(ipd->check_esd_status_queue,
+			&ipd->check_esd_status_work, ipd->esd_check_time);
 }
 
+/*
+ * Only runs once the IC has sent no report for esd_check_time, since
+ * every report pushes it back. While the panel stays idle the probe
+ * interval keeps doubling up to ESD_IDLE_BACKOFF_MAX times the period.
+ */
 static void ilitek_platform_esd_check(struct work_struct *pWork)
 {
 	uint8_t tx_data = 0x82, rx_data = 0;
 
 #if (INTERFACE == SPI_INTERFACE)
 	ipio_debug(DEBUG_BATTERY, "isEnablePollCheckEsd = %d\n", ipd->isEnablePollCheckEsd);
-	if (spi_write_then_read(core_spi->spi, &tx_data, 1, &rx_data, 1) < 0) {
+
+	/*
+	 * No plat_mutex here: recovery holds it while an upgrade cancel_syncs
+	 * this work. A reset or upgrade in progress answers for the IC instead.
+	 */
+	if (atomic_read(&ipd->do_reset) || core_firmware->isUpgrading) {
+		rx_data = 0xA3;
+	} else if (spi_write_then_read(core_spi->spi, &tx_data, 1, &rx_data, 1) < 0) {
 		ipio_err("spi Write Error\n");
 	}
 
@@ -280,31 +336,121 @@ static void ilitek_platform_esd_check(struct work_struct *pWork)
 		ipio_info("Doing ESD recovery (0x%x)\n", rx_data);
 		schedule_work(&ipd->esd_recovery);
 	} else {
+		ipd->esd_idle_delay = min(ipd->esd_idle_delay * 2, ipd->esd_check_time * ESD_IDLE_BACKOFF_MAX);
 		if (ipd->isEnablePollCheckEsd)
 			queue_delayed_work(ipd->check_esd_status_queue,
-				&ipd->check_esd_status_work, ipd->esd_check_time);
+				&ipd->check_esd_status_work, ipd->esd_idle_delay);
 	}
 #endif /* SPI_INTERFACE */
 }
 #endif /* ESD_CHECK */
 
+/*
+ * Bring the IC in line with what it's needed for: awake only while the
+ * screen is on and somebody has the input device open. A panel that's
+ * never opened stays asleep, and so do its ESD and charger work.
+ */
+void ilitek_platform_power_update(void)
+{
+	bool on;
+
+	mutex_lock(&ipd->touch_mutex);
+
+	on = ipd->isInputOpen && !ipd->isBlank;
+	if (on == !ipd->isSuspend)
+		goto out;
+
+	/* Whoever ran the upgrade calls back in once it's done */
+	if (core_firmware->isUpgrading) {
+		ipd->isPowerPending = true;
+		goto out;
+	}
+
+	ipio_info("IC %s, screen %s, input %s\n", on ? "on" : "off",
+		ipd->isBlank ? "off" : "on", ipd->isInputOpen ? "open" : "closed");
+
+	if (on)
+		core_config_ic_resume();
+	else
+		core_config_ic_suspend();
+
+out:
+	if (!core_firmware->isUpgrading)
+		ipd->isPowerPending = false;
+	mutex_unlock(&ipd->touch_mutex);
+}
+EXPORT_SYMBOL(ilitek_platform_power_update);
+
+static void ilitek_platform_resume_work(struct work_struct *work)
+{
+	bool wake = ipd->isSuspend && ipd->isInputOpen;
+
+	/* core_config_ic_resume keeps reports off until the IC is back */
+	ipd->isWaitFirstTouch = wake;
+	ilitek_platform_power_update();
+
+	if (wake && !ipd->isSuspend) {
+		ipd->resume_ms = ktime_to_ms(ktime_sub(ktime_get(), ipd->unblank_time));
+		ipio_info("Resumed %lld ms after unblank\n", ipd->resume_ms);
+	} else {
+		ipd->isWaitFirstTouch = false;
+	}
+
+	complete_all(&ipd->resume_done);
+}
+
+/*
+ * The screen came on. Leave the reset and host download to resume_work so
+ * the display doesn't wait for them.
+ */
+static void ilitek_platform_unblank(void)
+{
+	ipd->isBlank = false;
+	ipd->unblank_time = ktime_get();
+
+	/* A resume still running would complete the new one early */
+	flush_work(&ipd->resume_work);
+
+	reinit_completion(&ipd->resume_done);
+	queue_work(ipd->resume_wq, &ipd->resume_work);
+}
+
+/* For paths that need the IC up, if a resume is on its way */
+void ilitek_platform_resume_wait(void)
+{
+	wait_for_completion(&ipd->resume_done);
+}
+EXPORT_SYMBOL(ilitek_platform_resume_wait);
+
+#if (TP_PLATFORM != PT_MTK)
+static int ilitek_platform_input_open(struct input_dev *dev)
+{
+	ipd->isInputOpen = true;
+	ilitek_platform_power_update();
+	return 0;
+}
+
+static void ilitek_platform_input_close(struct input_dev *dev)
+{
+	ipd->isInputOpen = false;
+	ilitek_platform_power_update();
+}
+#endif /* PT_MTK */
+
 #if (TP_PLATFORM == PT_MTK)
 static void tpd_resume(struct device *h)
 {
 	ipio_info("TP Resume\n");
 
-	if (!core_firmware->isUpgrading) {
-		core_config_ic_resume();
-	}
+	ilitek_platform_unblank();
 }
 
 static void tpd_suspend(struct device *h)
 {
 	ipio_info("TP Suspend\n");
 
-	if (!core_firmware->isUpgrading) {
-		core_config_ic_suspend();
-	}
+	ipd->isBlank = true;
+	ilitek_platform_power_update();
 }
 #elif defined CONFIG_FB
 static int ilitek_platform_notifier_fb(struct notifier_block *self, unsigned long event, void *data)
@@ -329,9 +475,8 @@ static int ilitek_platform_notifier_fb(struct notifier_block *self, unsigned lon
 		{
 			ipio_info("TP Suspend\n");
 
-			if (!core_firmware->isUpgrading) {
-				core_config_ic_suspend();
-			}
+			ipd->isBlank = true;
+			ilitek_platform_power_update();
 		}
 #if (TP_PLATFORM == PT_SPRD)
 		else if (*blank == DRM_MODE_DPMS_ON)
@@ -341,9 +486,8 @@ static int ilitek_platform_notifier_fb(struct notifier_block *self, unsigned lon
 		{
 			ipio_info("TP Resuem\n");
 
-			if (!core_firmware->isUpgrading) {
-				core_config_ic_resume();
-			}
+			/* Stays asleep if nobody reads touches */
+			ilitek_platform_unblank();
 		}
 	}
 
@@ -360,22 +504,34 @@ static void ilitek_platform_early_suspend(struct early_suspend *h)
 
 	input_sync(core_fr->input_device);
 
-	core_fr->isEnableFR = false;
-
-	core_config_ic_suspend();
+	ipd->isBlank = true;
+	ilitek_platform_power_update();
 }
 
 static void ilitek_platform_late_resume(struct early_suspend *h)
 {
 	ipio_info("TP Resuem\n");
 
-	core_fr->isEnableFR = true;
-	core_config_ic_resume();
+	ilitek_platform_unblank();
 }
 #endif /* PT_MTK */
 
+/*
+ * Send the charger state to the IC again even if it didn't change, for
+ * when the IC lost it over a reset or a suspend.
+ */
+void ilitek_platform_plug_refresh(void)
+{
+	if (!ipd->isEnablePollCheckPower || ipd->isSuspend)
+		return;
+
+	ipd->charge_mode = 0;
+	mod_delayed_work(ipd->check_power_status_queue, &ipd->check_power_status_work, 0);
+}
+EXPORT_SYMBOL(ilitek_platform_plug_refresh);
+
 /**
- * reg_power_check - register a thread to inquery status at certain time.
+ * reg_power_check - follow charger changes through the power supply notifier.
  */
 static int ilitek_platform_reg_power_check(void)
 {
@@ -383,22 +539,30 @@ static int ilitek_platform_reg_power_check(void)
 
 #ifdef BATTERY_CHECK
 	INIT_DELAYED_WORK(&ipd->check_power_status_work, ilitek_platform_vpower_notify);
-	ipd->check_power_status_queue = create_workqueue("ili_power_check");
-	ipd->work_delay = msecs_to_jiffies(CHECK_BATTERY_TIME);
+	ipd->check_power_status_queue = create_singlethread_workqueue("ili_power_check");
+	ipd->charge_mode = 0;
 	ipd->isEnablePollCheckPower = true;
 	if (!ipd->check_power_status_queue) {
 		ipio_err("Failed to create a work thread to check power status\n");
 		ipd->vpower_reg_nb = false;
 		ret = -1;
 	} else {
-		ipio_info("Created a work thread to check power status at every %u jiffies\n",
-			 (unsigned)ipd->work_delay);
-
-		if (ipd->isEnablePollCheckPower) {
-			queue_delayed_work(ipd->check_power_status_queue, &ipd->check_power_status_work,
-					   ipd->work_delay);
-			ipd->vpower_reg_nb = true;
+		ipd->notifier_power.notifier_call = ilitek_platform_power_notifier;
+		ret = power_supply_reg_notifier(&ipd->notifier_power);
+		if (ret < 0) {
+			ipio_err("Failed to register power supply notifier, ret = %d\n", ret);
+			destroy_workqueue(ipd->check_power_status_queue);
+			ipd->check_power_status_queue = NULL;
+			ipd->isEnablePollCheckPower = false;
+			ipd->vpower_reg_nb = false;
+			return ret;
 		}
+
+		ipio_info("Registered power supply notifier for charger changes\n");
+		ipd->vpower_reg_nb = true;
+
+		/* The current state isn't announced, so pick it up once */
+		ilitek_platform_plug_refresh();
 	}
 #endif /* BATTERY_CHECK */
 
@@ -413,6 +577,7 @@ static int ilitek_platform_reg_esd_check(void)
 	INIT_DELAYED_WORK(&ipd->check_esd_status_work, ilitek_platform_esd_check);
 	ipd->check_esd_status_queue = create_workqueue("ili_esd_check");
 	ipd->esd_check_time = msecs_to_jiffies(CHECK_ESD_TIME);
+	ipd->esd_idle_delay = ipd->esd_check_time;
 	ipd->isEnablePollCheckEsd = true;
 	if (!ipd->check_esd_status_queue) {
 		ipio_err("Failed to create a work thread to check power status\n");
@@ -469,7 +634,16 @@ static int ilitek_platform_reg_suspend(void)
 
 static irqreturn_t ilitek_platform_irq_top_half(int irq, void *dev_id)
 {
-	if (irq != ipd->isr_gpio || core_firmware->isUpgrading)
+	if (irq != ipd->isr_gpio)
+		return IRQ_NONE;
+
+	/* A command is waiting for this edge, it's not a finger report */
+	if (atomic_read(&ipd->int_wait)) {
+		complete(&ipd->int_done);
+		return IRQ_HANDLED;
+	}
+
+	if (core_firmware->isUpgrading)
 		return IRQ_NONE;
 
 	return IRQ_WAKE_THREAD;
@@ -502,6 +676,9 @@ static int ilitek_platform_input_init(void)
 		}
 	}
 	core_fr_input_set_param(ipd->input_device);
+
+	/* tpd owns the input device, so it counts as always open */
+	ipd->isInputOpen = true;
 	return ret;
 #else
 	ipd->input_device = input_allocate_device();
@@ -525,6 +702,8 @@ static int ilitek_platform_input_init(void)
 #endif
 
 	core_fr_input_set_param(ipd->input_device);
+	ipd->input_device->open = ilitek_platform_input_open;
+	ipd->input_device->close = ilitek_platform_input_close;
 	/* register the input device to input sub-system */
 	ret = input_register_device(ipd->input_device);
 	if (ret < 0) {
@@ -546,33 +725,43 @@ out:
 }
 
 #ifdef BOOT_FW_UPGRADE
-static int kthread_handler(void *arg)
+/*
+ * Called once the firmware loader has the boot image, or gave up on it.
+ * Upgrade right away instead of waiting a fixed time for the filesystem.
+ */
+static void ilitek_platform_boot_fw_cb(const struct firmware *fw, void *context)
 {
-	int ret = 0, retry = 0;
-	char *str = (char *)arg;
+	int ret = 0;
 
-	retry = core_firmware->retry_times;
+	if (fw == NULL)
+		ipio_err("Failed to request %s, upgrade with ili file\n", BOOT_FW_HEX_NAME);
 
-	if (strcmp(str, "boot_fw") == 0) {
-		/* FW Upgrade event */
-		core_firmware->isboot = true;
+	/* FW Upgrade event */
+	core_firmware->isboot = true;
+	core_firmware->fw_req = fw;
 
-		ilitek_platform_disable_irq();
+	/* Same as the fw_upgrade worker, nobody else may touch the IC meanwhile */
+	mutex_lock(&ipd->plat_mutex);
+	ilitek_platform_disable_irq();
 
-		ret = core_firmware_upgrade(UPGRADE_FLASH, HEX_FILE, OPEN_FW_METHOD);
-		if (ret < 0)
-			ipio_err("boot upgrade failed");
+	ret = core_firmware_upgrade(UPGRADE_FLASH, (fw ? HEX_FILE : ILI_FILE), REQUEST_FIRMWARE);
+	if (ret < 0)
+		ipio_err("boot upgrade failed");
 
-		ilitek_platform_enable_irq();
+	ilitek_platform_enable_irq();
+	mutex_unlock(&ipd->plat_mutex);
 
-		ilitek_platform_input_init();
+	ilitek_platform_input_init();
 
-		core_firmware->isboot = false;
-	}  else {
-		ipio_err("Unknown EVENT\n");
-	}
+	core_firmware->fw_req = NULL;
+	core_firmware->isboot = false;
 
-	return ret;
+	release_firmware(fw);
+
+	/* Sleep until the input device is opened */
+	ilitek_platform_power_update();
+
+	complete_all(&ipd->boot_fw_done);
 }
 #endif
 
@@ -739,6 +928,52 @@ static int ilitek_platform_core_init(void)
 	return 0;
 }
 
+static void ilitek_platform_reset_work(struct work_struct *work)
+{
+	ktime_t t = ktime_get();
+
+	if (ipd->reset_mode == HW_RST) {
+		ilitek_platform_tp_hw_reset(true);
+		msleep(RESET_SETTLE_TIME);
+		ipd->reset_ret = 0;
+	} else {
+		ipd->reset_ret = core_config_ic_reset();
+	}
+
+	ipd->reset_us = ktime_us_delta(ktime_get(), t);
+	ipio_debug(DEBUG_CONFIG, "%s reset done in %lld us\n",
+		(ipd->reset_mode == HW_RST) ? "HW" : "SW", ipd->reset_us);
+
+	complete_all(&ipd->reset_done);
+}
+
+/*
+ * Kick off a HW_RST or SW_RST and return right away. The caller must pair
+ * it with ilitek_platform_reset_wait() before talking to the IC again.
+ */
+void ilitek_platform_reset_start(int mode)
+{
+	if (ipd->isResetPending)
+		ilitek_platform_reset_wait();
+
+	ipd->reset_mode = mode;
+	ipd->isResetPending = true;
+	reinit_completion(&ipd->reset_done);
+	queue_work(system_highpri_wq, &ipd->reset_work);
+}
+EXPORT_SYMBOL(ilitek_platform_reset_start);
+
+int ilitek_platform_reset_wait(void)
+{
+	if (!ipd->isResetPending)
+		return 0;
+
+	wait_for_completion(&ipd->reset_done);
+	ipd->isResetPending = false;
+	return ipd->reset_ret;
+}
+EXPORT_SYMBOL(ilitek_platform_reset_wait);
+
 int ilitek_platform_reset_ctrl(bool rst, int mode)
 {
 	int ret = 0;
@@ -749,26 +984,28 @@ int ilitek_platform_reset_ctrl(bool rst, int mode)
 	switch (mode) {
 		case SW_RST:
 			ipio_info("SW RESET\n");
-			ret = core_config_ic_reset();
+			ilitek_platform_reset_start(SW_RST);
+			ret = ilitek_platform_reset_wait();
 			break;
 		case HW_RST:
 			ipio_info("HW RESET ONLY\n");
-			ilitek_platform_tp_hw_reset(rst);
-			mdelay(100);
+			if (!rst) {
+				ilitek_platform_tp_hw_reset(false);
+				break;
+			}
+			ilitek_platform_reset_start(HW_RST);
+			ret = ilitek_platform_reset_wait();
 			break;
 		case HW_RST_HOST_DOWNLOAD:
-			ipio_info("HW_RST_HOST_DOWNLOAD\n");
-			ilitek_platform_tp_hw_reset(rst);
-			ret = core_firmware_upgrade(UPGRADE_IRAM, HEX_FILE, OPEN_FW_METHOD);
-			if (ret < 0)
-				ipio_err("host download with retry failed\n");
-			break;
 		case SW_RST_HOST_DOWNLOAD:
-			ipio_info("SW_RST_HOST_DOWNLOAD\n");
-			ret = core_config_ic_reset();
+			ipio_info("%s\n", (mode == HW_RST_HOST_DOWNLOAD) ? "HW_RST_HOST_DOWNLOAD" : "SW_RST_HOST_DOWNLOAD");
+			/* The image is prepared while the IC resets, fw_upgrade_iram waits for it */
+			ilitek_platform_reset_start((mode == HW_RST_HOST_DOWNLOAD) ? HW_RST : SW_RST);
 			ret = core_firmware_upgrade(UPGRADE_IRAM, HEX_FILE, OPEN_FW_METHOD);
 			if (ret < 0)
 				ipio_err("host download with retry failed\n");
+			/* In case the upgrade gave up before getting that far */
+			ilitek_platform_reset_wait();
 			break;
 		default:
 			ipio_err("Unknown RST mode (%d)\n", mode);
@@ -781,6 +1018,227 @@ int ilitek_platform_reset_ctrl(bool rst, int mode)
 	return ret;
 }
 
+const char *ilitek_esd_tier_name[ESD_TIER_NUM] = {
+	[ESD_TIER_RESYNC] = "resync",
+	[ESD_TIER_SOFT_RESET] = "soft_reset",
+	[ESD_TIER_IRAM_RELOAD] = "iram_reload",
+	[ESD_TIER_FULL_RESET] = "full_reset",
+};
+
+/* The IC answers 0xA3 to 0x82 as long as its SPI slave is alive */
+static bool ilitek_platform_esd_probe(void)
+{
+#if (INTERFACE == SPI_INTERFACE)
+	uint8_t tx_data = 0x82, rx_data = 0;
+
+	if (spi_write_then_read(core_spi->spi, &tx_data, 1, &rx_data, 1) < 0)
+		return false;
+
+	return (rx_data == 0xA3);
+#else
+	return false;
+#endif
+}
+
+static int ilitek_platform_esd_tier(int tier)
+{
+	int ret = 0, i;
+#ifdef HOST_DOWNLOAD
+	bool force;
+#endif
+
+	switch (tier) {
+		case ESD_TIER_RESYNC:
+			/* A glitch on the bus often only costs one handshake */
+			for (i = 0; i < ESD_RESYNC_RETRY; i++) {
+				usleep_range(1000, 1500);
+				if (ilitek_platform_esd_probe())
+					return 0;
+			}
+			return -EIO;
+		case ESD_TIER_SOFT_RESET:
+			atomic_set(&ipd->do_reset, true);
+#ifdef HOST_DOWNLOAD
+			/* Restart MCU on the code that's already in IRAM */
+			ret = core_config_ice_mode_enable(STOP_MCU);
+			if (ret >= 0) {
+				core_config_ice_mode_write(0x40040, 0xAE, 1);
+				core_config_ice_mode_disable();
+				msleep(10);
+			}
+#else
+			ret = core_config_ic_reset();
+#endif
+			atomic_set(&ipd->do_reset, false);
+			break;
+		case ESD_TIER_IRAM_RELOAD:
+			/* Only the blocks whose IRAM crc is wrong are sent again */
+			if (!core_firmware->isCacheValid)
+				return -EINVAL;
+			ret = core_firmware_upgrade(UPGRADE_IRAM, HEX_FILE, OPEN_FW_METHOD);
+			break;
+		case ESD_TIER_FULL_RESET:
+#ifdef HOST_DOWNLOAD
+			force = core_firmware->isForceDownload;
+			core_firmware->isForceDownload = true;
+			ret = ilitek_platform_reset_ctrl(true, HW_RST_HOST_DOWNLOAD);
+			core_firmware->isForceDownload = force;
+#else
+			ret = ilitek_platform_reset_ctrl(true, RST_METHODS);
+#endif
+			/* Nothing left to escalate to */
+			return ret;
+		default:
+			return -EINVAL;
+	}
+
+	if (ret < 0)
+		return ret;
+
+	return ilitek_platform_esd_probe() ? 0 : -EIO;
+}
+
+/*
+ * Escalate from the cheapest step to a full reload, stopping at the first
+ * one that brings the IC back. The caller holds plat_mutex.
+ */
+int ilitek_platform_esd_recover(void)
+{
+	int ret = -EIO, tier = ESD_TIER_RESYNC;
+	ktime_t t;
+
+#if (INTERFACE != SPI_INTERFACE)
+	/* Without the probe there's no telling whether a cheaper step worked */
+	tier = ESD_TIER_FULL_RESET;
+#endif
+
+	ilitek_platform_disable_irq();
+
+	for (; tier < ESD_TIER_NUM; tier++) {
+		t = ktime_get();
+		ipd->esd_try[tier]++;
+		ret = ilitek_platform_esd_tier(tier);
+		ipd->esd_us[tier] = ktime_us_delta(ktime_get(), t);
+
+		ipio_info("ESD recovery %s %s in %lld us\n", ilitek_esd_tier_name[tier],
+			(ret < 0) ? "failed" : "done", ipd->esd_us[tier]);
+
+		if (ret >= 0) {
+			ipd->esd_ok[tier]++;
+			break;
+		}
+	}
+
+	ilitek_platform_enable_irq();
+	return ret;
+}
+EXPORT_SYMBOL(ilitek_platform_esd_recover);
+
+const char *ilitek_probe_stage_name[PROBE_STAGE_NUM] = {
+	[PROBE_STAGE_CORE] = "core",
+	[PROBE_STAGE_RESET] = "reset",
+	[PROBE_STAGE_FW] = "fw",
+	[PROBE_STAGE_INFO] = "info",
+	[PROBE_STAGE_ISR] = "isr",
+	[PROBE_STAGE_INPUT] = "input",
+	[PROBE_STAGE_WORKS] = "works",
+};
+EXPORT_SYMBOL(ilitek_probe_stage_name);
+
+static void ilitek_platform_probe_stage(int stage, ktime_t *t)
+{
+	ktime_t now = ktime_get();
+
+	ipd->probe_us[stage] = ktime_us_delta(now, *t);
+	*t = now;
+	ipio_info("Probe stage %s took %lld us\n", ilitek_probe_stage_name[stage], ipd->probe_us[stage]);
+}
+
+/*
+ * Everything in probe that talks to the IC. It runs after probe returned,
+ * so the device is bound and the boot goes on while the IC comes up.
+ */
+static void ilitek_platform_probe_work(struct work_struct *work)
+{
+	ktime_t t = ktime_get();
+	bool found = true;
+
+	/* Pull TP RST low to high after request GPIO succeed for normal work. */
+	if (ilitek_platform_reset_ctrl(true, SW_RST) < 0)
+		ipio_err("Failed to do hw reset\n");
+
+	if (core_config_get_chip_id() < 0) {
+		ipio_err("Failed to get chip id\n");
+		found = false;
+	}
+
+	ilitek_platform_probe_stage(PROBE_STAGE_RESET, &t);
+
+#ifndef HOST_DOWNLOAD
+	core_config_read_flash_info();
+#else
+	ilitek_platform_reset_ctrl(true, RST_METHODS);
+#endif
+
+	ilitek_platform_probe_stage(PROBE_STAGE_FW, &t);
+
+	if (ilitek_platform_read_tp_info() < 0)
+		ipio_err("Failed to read TP info\n");
+
+	ilitek_platform_probe_stage(PROBE_STAGE_INFO, &t);
+
+	if (ilitek_platform_isr_register() < 0)
+		ipio_err("Failed to register ISR\n");
+
+	ilitek_platform_probe_stage(PROBE_STAGE_ISR, &t);
+
+#ifndef BOOT_FW_UPGRADE
+	if (ilitek_platform_input_init() < 0)
+		ipio_err("Failed to init input device in kernel\n");
+#endif
+
+	ilitek_platform_probe_stage(PROBE_STAGE_INPUT, &t);
+
+	if (ilitek_platform_reg_suspend() < 0)
+		ipio_err("Failed to register suspend/resume function\n");
+
+	if (ilitek_platform_reg_power_check() < 0)
+		ipio_err("Failed to register power check function\n");
+
+	if (ilitek_platform_reg_esd_check() < 0)
+		ipio_err("Failed to register esd check function\n");
+
+	if (ilitek_proc_init() < 0)
+		ipio_err("Failed to create ilitek device nodes\n");
+
+	ilitek_platform_probe_stage(PROBE_STAGE_WORKS, &t);
+
+	ipd->probe_total_us = ktime_us_delta(ktime_get(), ipd->probe_start);
+	ipio_info("Probe done in %lld us\n", ipd->probe_total_us);
+
+#if (TP_PLATFORM == PT_MTK)
+	/* Only claim the panel once the IC has answered, else tpd tries the next one */
+	if (found)
+		tpd_load_status = 1;
+#endif /* PT_MTK */
+
+#ifdef BOOT_FW_UPGRADE
+	if (request_firmware_nowait(THIS_MODULE, true, BOOT_FW_HEX_NAME, ipd->dev,
+			GFP_KERNEL, ipd, ilitek_platform_boot_fw_cb) < 0) {
+		ipio_err("Failed to request boot fw, register input device only\n");
+		ilitek_platform_input_init();
+		ilitek_platform_power_update();
+		complete_all(&ipd->boot_fw_done);
+	}
+#else
+	/* Sleep until the input device is opened */
+	ilitek_platform_power_update();
+	complete_all(&ipd->boot_fw_done);
+#endif
+
+	complete_all(&ipd->probe_done);
+}
+
 #if (INTERFACE == I2C_INTERFACE)
 static int ilitek_platform_remove(struct i2c_client *client)
 #else
@@ -789,6 +1247,12 @@ static int ilitek_platform_remove(struct spi_device *spi)
 {
 	ipio_info("Remove platform components\n");
 
+	/* Let the deferred part of probe finish before tearing it down */
+	wait_for_completion(&ipd->probe_done);
+#ifdef BOOT_FW_UPGRADE
+	wait_for_completion(&ipd->boot_fw_done);
+#endif
+
 	if (ipd->isEnableIRQ) {
 		disable_irq_nosync(ipd->isr_gpio);
 	}
@@ -803,13 +1267,21 @@ static int ilitek_platform_remove(struct spi_device *spi)
 #else
 	unregister_early_suspend(&ipd->early_suspend);
 #endif /* CONFIG_FB */
+	destroy_workqueue(ipd->resume_wq);
 
 	if (ipd->input_device != NULL) {
 		input_unregister_device(ipd->input_device);
 		input_free_device(ipd->input_device);
 	}
 
+	core_firmware_cache_free();
+	core_fr_scan_gov_stop();
+	flush_work(&ipd->reset_work);
+
 	if (ipd->vpower_reg_nb) {
+#ifdef BATTERY_CHECK
+		power_supply_unreg_notifier(&ipd->notifier_power);
+#endif
 		cancel_delayed_work_sync(&ipd->check_power_status_work);
 		destroy_workqueue(ipd->check_power_status_queue);
 	}
@@ -884,8 +1356,15 @@ static int ilitek_platform_probe(struct spi_device *spi)
 	ipd->isEnableIRQ = false;
 	ipd->isEnablePollCheckPower = false;
 	ipd->isEnablePollCheckEsd = false;
+	ipd->isSuspend = false;
+	ipd->isBlank = false;
+	ipd->isInputOpen = false;
+	ipd->isPowerPending = false;
 	ipd->vpower_reg_nb = false;
 	ipd->vesd_reg_nb = false;
+	ipd->probe_start = ktime_get();
+	init_completion(&ipd->probe_done);
+	init_completion(&ipd->boot_fw_done);
 
 	ipio_info("Driver Version : %s\n", DRIVER_VERSION);
 	ipio_info("Driver on platform :  %x\n", TP_PLATFORM);
@@ -902,6 +1381,14 @@ static int ilitek_platform_probe(struct spi_device *spi)
 	mutex_init(&ipd->plat_mutex);
 	mutex_init(&ipd->touch_mutex);
 	spin_lock_init(&ipd->plat_spinlock);
+	init_completion(&ipd->int_done);
+	atomic_set(&ipd->int_wait, 0);
+	INIT_WORK(&ipd->resume_work, ilitek_platform_resume_work);
+	init_completion(&ipd->resume_done);
+	complete_all(&ipd->resume_done);
+	INIT_WORK(&ipd->reset_work, ilitek_platform_reset_work);
+	init_completion(&ipd->reset_done);
+	ipd->isResetPending = false;
 
 	/* Init members for debug */
 	mutex_init(&ipd->ilitek_debug_mutex);
@@ -927,54 +1414,24 @@ static int ilitek_platform_probe(struct spi_device *spi)
 	if (ilitek_platform_gpio() < 0)
 		ipio_err("Failed to request gpios\n ");
 
-	/* Pull TP RST low to high after request GPIO succeed for normal work. */
-	if (ilitek_platform_reset_ctrl(true, SW_RST) < 0)
-		ipio_err("Failed to do hw reset\n");
-
-	if (core_config_get_chip_id() < 0)
-		ipio_err("Failed to get chip id\n");
-
-#ifndef HOST_DOWNLOAD
-	core_config_read_flash_info();
-#else
-	ilitek_platform_reset_ctrl(true, RST_METHODS);
-#endif
-
-	if (ilitek_platform_read_tp_info() < 0)
-		ipio_err("Failed to read TP info\n");
-
-	if (ilitek_platform_isr_register() < 0)
-		ipio_err("Failed to register ISR\n");
-
-#ifndef BOOT_FW_UPGRADE
-	if (ilitek_platform_input_init() < 0)
-		ipio_err("Failed to init input device in kernel\n");
-#endif
-
-	if (ilitek_platform_reg_suspend() < 0)
-		ipio_err("Failed to register suspend/resume function\n");
-
-	if (ilitek_platform_reg_power_check() < 0)
-		ipio_err("Failed to register power check function\n");
+	ipd->resume_wq = alloc_ordered_workqueue("ilitek_resume", WQ_HIGHPRI);
+	if (ipd->resume_wq == NULL) {
+		ipio_err("Failed to create resume workqueue\n");
+		return -ENOMEM;
+	}
 
-	if (ilitek_platform_reg_esd_check() < 0)
-		ipio_err("Failed to register esd check function\n");
+	ipd->probe_us[PROBE_STAGE_CORE] = ktime_us_delta(ktime_get(), ipd->probe_start);
 
-	if (ilitek_proc_init() < 0)
-		ipio_err("Failed to create ilitek device nodes\n");
+	INIT_WORK(&ipd->probe_work, ilitek_platform_probe_work);
 
 #if (TP_PLATFORM == PT_MTK)
-	tpd_load_status = 1;
+	/* tpd_local_init looks at tpd_load_status as soon as probe returns */
+	ilitek_platform_probe_work(&ipd->probe_work);
+#else
+	/* Talking to the IC takes hundreds of ms, don't hold up the boot for it */
+	queue_work(system_unbound_wq, &ipd->probe_work);
 #endif /* PT_MTK */
 
-#ifdef BOOT_FW_UPGRADE
-	ipd->update_thread = kthread_run(kthread_handler, "boot_fw", "ili_fw_boot");
-	if (ipd->update_thread == (struct task_struct *)ERR_PTR) {
-		ipd->update_thread = NULL;
-		ipio_err("Failed to create fw upgrade thread\n");
-	}
-#endif
-
 	return 0;
 }
 
@@ -1010,6 +1467,9 @@ static struct i2c_driver tp_i2c_driver = {
 		   .name = DEVICE_ID,
 		   .owner = THIS_MODULE,
 		   .of_match_table = tp_match_table,
+#if (TP_PLATFORM != PT_MTK) && (KERNEL_VERSION(4, 2, 0) <= LINUX_VERSION_CODE)
+		   .probe_type = PROBE_PREFER_ASYNCHRONOUS,
+#endif
 		   },
 	.probe = ilitek_platform_probe,
 	.remove = ilitek_platform_remove,
@@ -1024,6 +1484,9 @@ static struct spi_driver tp_spi_driver = {
 		.name	= DEVICE_ID,
 		.owner = THIS_MODULE,
 		.of_match_table = tp_match_table,
+#if (TP_PLATFORM != PT_MTK) && (KERNEL_VERSION(4, 2, 0) <= LINUX_VERSION_CODE)
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+#endif
 	},
 	.probe = ilitek_platform_probe,
 	.remove = ilitek_platform_remove,
@@ -25,6 +25,27 @@
 #ifndef __PLATFORM_H
 #define __PLATFORM_H
 
+/* ESD recovery steps, tried in order until the IC answers again */
+enum esd_tier {
+	ESD_TIER_RESYNC = 0,
+	ESD_TIER_SOFT_RESET,
+	ESD_TIER_IRAM_RELOAD,
+	ESD_TIER_FULL_RESET,
+	ESD_TIER_NUM,
+};
+
+/* Probe stages, the first one runs in probe and the rest in probe_work */
+enum probe_stage {
+	PROBE_STAGE_CORE = 0,
+	PROBE_STAGE_RESET,
+	PROBE_STAGE_FW,
+	PROBE_STAGE_INFO,
+	PROBE_STAGE_ISR,
+	PROBE_STAGE_INPUT,
+	PROBE_STAGE_WORKS,
+	PROBE_STAGE_NUM,
+};
+
 struct ilitek_platform_data {
 
 	struct i2c_client *client;
@@ -55,30 +76,72 @@ struct ilitek_platform_data {
 	bool isEnableIRQ;
 	bool isEnablePollCheckPower;
 	bool isEnablePollCheckEsd;
+	bool isSuspend;
+
+	/* IC only runs while the screen is on and the input device is open */
+	bool isBlank;
+	bool isInputOpen;
+	/* A change came in during an upgrade and still has to be applied */
+	bool isPowerPending;
+
+	/* Resume runs off the unblank path, reports stay off until it's done */
+	struct workqueue_struct *resume_wq;
+	struct work_struct resume_work;
+	struct completion resume_done;
+	ktime_t unblank_time;
+	bool isWaitFirstTouch;
+	s64 resume_ms;
+	s64 unblank_touch_ms;
 
 	atomic_t do_reset;
 
+	/* Resets run from reset_work, so callers can prepare while the IC settles */
+	struct work_struct reset_work;
+	struct completion reset_done;
+	int reset_mode;
+	int reset_ret;
+	bool isResetPending;
+	s64 reset_us;
+
+	/* Let command waits sleep on INT instead of polling the IC */
+	struct completion int_done;
+	atomic_t int_wait;
+	bool int_wait_irq;
+
 #ifdef CONFIG_FB
 	struct notifier_block notifier_fb;
 #else
 	struct early_suspend early_suspend;
 #endif
 
-#ifdef BOOT_FW_UPGRADE
-	struct task_struct *update_thread;
-#endif
-
 	/* check battery & ESD workqueue functions */
 	struct delayed_work check_power_status_work;
 	struct delayed_work check_esd_status_work;
 	struct workqueue_struct *check_power_status_queue;
 	struct workqueue_struct *check_esd_status_queue;
 	struct work_struct esd_recovery;
-	unsigned long work_delay;
 	unsigned long esd_check_time;
+	unsigned long esd_idle_delay;
 	bool vpower_reg_nb;
 	bool vesd_reg_nb;
 
+	/* Charger changes come from the power supply notifier */
+	struct notifier_block notifier_power;
+	int charge_mode;
+
+	/* Per step attempts, successes and last duration (us) of ESD recovery */
+	uint32_t esd_try[ESD_TIER_NUM];
+	uint32_t esd_ok[ESD_TIER_NUM];
+	s64 esd_us[ESD_TIER_NUM];
+
+	/* Deferred part of probe and how long each stage took (us) */
+	struct work_struct probe_work;
+	struct completion probe_done;
+	struct completion boot_fw_done;
+	ktime_t probe_start;
+	s64 probe_us[PROBE_STAGE_NUM];
+	s64 probe_total_us;
+
 	/* Sending report data to users for the debug */
 	bool debug_node_open;
 	int debug_data_frame;
@@ -96,6 +159,14 @@ extern struct ilitek_platform_data *ipd;
 
 /* exported from platform.c */
 extern int ilitek_platform_reset_ctrl(bool rst, int mode);
+extern void ilitek_platform_reset_start(int mode);
+extern int ilitek_platform_reset_wait(void);
+extern int ilitek_platform_esd_recover(void);
+extern void ilitek_platform_plug_refresh(void);
+extern void ilitek_platform_power_update(void);
+extern void ilitek_platform_resume_wait(void);
+extern const char *ilitek_esd_tier_name[ESD_TIER_NUM];
+extern const char *ilitek_probe_stage_name[PROBE_STAGE_NUM];
 extern void ilitek_platform_disable_irq(void);
 extern void ilitek_platform_enable_irq(void);
 extern int ilitek_platform_read_tp_info(void);
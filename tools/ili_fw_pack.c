@@ -0,0 +1,173 @@
+/*
+ * ILITEK Touch IC driver
+ *
+ * Copyright (C) 2011 ILI Technology Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+/*
+ * Host side packer: converts an Intel HEX firmware into the binary
+ * container described in core/fw_bin.h, so the driver can use it straight
+ * from the firmware loader without parsing.
+ *
+ *   gcc -O2 -o ili_fw_pack tools/ili_fw_pack.c
+ *   ./ili_fw_pack FW.hex ILITEK_FW
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "../core/fw_bin.h"
+#include "../core/ili_hex.h"
+
+static uint8_t image[ILI_FW_BIN_PAYLOAD_LEN];
+static struct ili_fw_bin_header hdr;
+
+static uint32_t crc32_be(const uint8_t *data, uint32_t len)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	int j;
+
+	while (len--) {
+		crc ^= (uint32_t)*data++ << 24;
+		for (j = 0; j < 8; j++)
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : (crc << 1);
+	}
+
+	return crc;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+/* The same decoder the driver runs, see core/ili_hex.h */
+static int parse_hex(FILE *f)
+{
+	struct ili_hex_info info;
+	uint8_t *text;
+	long size;
+	int i, ret;
+
+	if (fseek(f, 0, SEEK_END) < 0 || (size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) < 0)
+		return -1;
+
+	text = malloc(size ? size : 1);
+	if (text == NULL || fread(text, 1, size, f) != (size_t)size) {
+		free(text);
+		return -1;
+	}
+
+	ret = ili_hex_decode(text, size, image, sizeof(image), &info);
+	free(text);
+	if (ret < 0) {
+		fprintf(stderr, "bad record (%d) before offset %u\n", ret, info.err_offset);
+		return -1;
+	}
+
+	for (i = 0; i < ILI_FW_BIN_BLOCKS; i++) {
+		hdr.block[i].start = info.block[i].start;
+		hdr.block[i].end = info.block[i].end;
+		hdr.block[i].fix_mem_start = info.block[i].end ? info.block[i].fix_mem_start : ILI_FW_BIN_NO_MEM;
+	}
+
+	hdr.hex_tag = info.hex_tag;
+	hdr.start_addr = info.start_addr;
+	hdr.end_addr = info.end_addr;
+	hdr.block_number = info.block_number;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	FILE *in, *out;
+	uint8_t raw[sizeof(struct ili_fw_bin_header)];
+	struct ili_fw_bin_block *b;
+	uint32_t i, len;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s <fw.hex> <out.bin>\n", argv[0]);
+		return 1;
+	}
+
+	in = fopen(argv[1], "r");
+	if (in == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	memset(image, 0xFF, sizeof(image));
+
+	if (parse_hex(in) < 0) {
+		fclose(in);
+		return 1;
+	}
+	fclose(in);
+
+	for (i = 0; i < ILI_FW_BIN_BLOCKS; i++) {
+		b = &hdr.block[i];
+		if (b->end == 0)
+			continue;
+
+		len = b->end - b->start + 1;
+		if (b->end >= sizeof(image) || len < 4) {
+			fprintf(stderr, "block %u: bad range 0x%x - 0x%x\n", i, b->start, b->end);
+			return 1;
+		}
+		b->crc = crc32_be(image + b->start, len - 4);
+		printf("Block[%u]: 0x%06x - 0x%06x crc 0x%08x\n", i, b->start, b->end, b->crc);
+	}
+
+	hdr.magic = ILI_FW_BIN_MAGIC;
+	hdr.version = ILI_FW_BIN_VERSION;
+	hdr.header_len = sizeof(hdr);
+	hdr.fw_ver = (image[ILI_FW_BIN_VER_ADDR] << 24) | (image[ILI_FW_BIN_VER_ADDR + 1] << 16) |
+		(image[ILI_FW_BIN_VER_ADDR + 2] << 8) | image[ILI_FW_BIN_VER_ADDR + 3];
+	hdr.payload_len = sizeof(image);
+	hdr.payload_crc = crc32_be(image, sizeof(image));
+
+	/* Serialize as little endian whatever the host is */
+	for (i = 0; i < sizeof(hdr) / 4; i++)
+		put_le32(raw + i * 4, ((uint32_t *)&hdr)[i]);
+
+	hdr.header_crc = crc32_be(raw, offsetof(struct ili_fw_bin_header, header_crc));
+	put_le32(raw + offsetof(struct ili_fw_bin_header, header_crc), hdr.header_crc);
+
+	out = fopen(argv[2], "wb");
+	if (out == NULL) {
+		perror(argv[2]);
+		return 1;
+	}
+
+	if (fwrite(raw, sizeof(raw), 1, out) != 1 || fwrite(image, sizeof(image), 1, out) != 1) {
+		perror(argv[2]);
+		fclose(out);
+		return 1;
+	}
+	fclose(out);
+
+	printf("fw ver 0x%08x, tag 0x%x, %u blocks, end 0x%x -> %s\n",
+		hdr.fw_ver, hdr.hex_tag, hdr.block_number, hdr.end_addr, argv[2]);
+	return 0;
+}
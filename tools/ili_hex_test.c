@@ -0,0 +1,356 @@
+/*
+ * ILITEK Touch IC driver
+ *
+ * Copyright (C) 2011 ILI Technology Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+/*
+ * Host test and benchmark for the Intel HEX decoder in core/ili_hex.h,
+ * the one convert_hex_file() runs in the driver.
+ *
+ * It writes a 160 KB image as hex the way ILITEK firmware is laid out
+ * (extended address records, 16 byte data records, AF/B0 block info),
+ * checks that it decodes back exactly, checks that corrupted records are
+ * rejected with the right error, then times the decode. Pass a real
+ * firmware hex to time that one as well.
+ *
+ *   gcc -O2 -o ili_hex_test tools/ili_hex_test.c
+ *   ./ili_hex_test [FW.hex]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "../core/ili_hex.h"
+
+#define IMAGE_LEN	(160 * 1024)	/* MAX_HEX_FILE_SIZE */
+#define BENCH_LOOPS	200
+
+struct test_block {
+	uint32_t start;
+	uint32_t end;
+	uint32_t mem;
+};
+
+/* AP, data and MP code, as in a typical ILI9881 image */
+static const struct test_block blocks[] = {
+	{0x00000, 0x0FFFF, ILI_HEX_NO_MEM},
+	{0x10000, 0x10FFF, 0x2C000},
+	{0x11000, 0x27FFF, ILI_HEX_NO_MEM},
+};
+
+static uint8_t image[IMAGE_LEN];
+static uint8_t out[IMAGE_LEN];
+static char *hex;
+static uint32_t hex_len;
+static int failed;
+
+static void emit(int type, uint32_t addr, const uint8_t *data, int len)
+{
+	uint8_t sum = len + (addr >> 8) + addr + type;
+	int i;
+
+	hex_len += sprintf(hex + hex_len, ":%02X%04X%02X", len, addr & 0xFFFF, type);
+	for (i = 0; i < len; i++) {
+		hex_len += sprintf(hex + hex_len, "%02X", data[i]);
+		sum += data[i];
+	}
+	hex_len += sprintf(hex + hex_len, "%02X\r\n", (uint8_t)-sum);
+}
+
+static void build_hex(void)
+{
+	uint8_t rec[7];
+	uint32_t addr, i;
+
+	srand(0x9881);
+	for (i = 0; i < IMAGE_LEN; i++)
+		image[i] = rand();
+
+	/* Each byte takes a bit more than two characters with the record overhead */
+	hex = malloc(IMAGE_LEN * 3);
+	hex_len = 0;
+
+	for (i = 0; i < sizeof(blocks) / sizeof(blocks[0]); i++) {
+		rec[0] = blocks[i].start >> 16;
+		rec[1] = blocks[i].start >> 8;
+		rec[2] = blocks[i].start;
+		rec[3] = blocks[i].end >> 16;
+		rec[4] = blocks[i].end >> 8;
+		rec[5] = blocks[i].end;
+		rec[6] = i;
+		emit(ILI_HEX_TAG_AF, 0, rec, 7);
+
+		if (blocks[i].mem != ILI_HEX_NO_MEM) {
+			rec[0] = blocks[i].mem >> 16;
+			rec[1] = blocks[i].mem >> 8;
+			rec[2] = blocks[i].mem;
+			rec[3] = i;
+			emit(ILI_HEX_TAG_B0, 0, rec, 4);
+		}
+	}
+
+	for (addr = 0; addr < IMAGE_LEN; addr += 16) {
+		if ((addr & 0xFFFF) == 0) {
+			rec[0] = addr >> 24;
+			rec[1] = addr >> 16;
+			emit(0x04, 0, rec, 2);
+		}
+		emit(0x00, addr, image + addr, 16);
+	}
+
+	emit(0x01, 0, NULL, 0);
+}
+
+static void check(int ok, const char *what)
+{
+	printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+	if (!ok)
+		failed++;
+}
+
+static int decode(const char *text, uint32_t len, struct ili_hex_info *info)
+{
+	memset(out, 0xFF, sizeof(out));
+	return ili_hex_decode((const uint8_t *)text, len, out, sizeof(out), info);
+}
+
+/* Decode a copy of the good hex with one change applied at the given offset */
+static int decode_patched(uint32_t off, const char *patch, uint32_t cut)
+{
+	struct ili_hex_info info;
+	char *text = malloc(hex_len + 1);
+	int ret;
+
+	memcpy(text, hex, hex_len + 1);
+	if (patch != NULL)
+		memcpy(text + off, patch, strlen(patch));
+
+	ret = decode(text, cut ? cut : hex_len, &info);
+	free(text);
+	return ret;
+}
+
+static void test_good(void)
+{
+	struct ili_hex_info info;
+	int i, ok = 1;
+
+	check(decode(hex, hex_len, &info) == 0, "decode a 160 KB image");
+	check(memcmp(out, image, IMAGE_LEN) == 0, "image comes back byte for byte");
+	check(info.start_addr == 0 && info.end_addr == IMAGE_LEN, "start and end address");
+	check(info.hex_tag == ILI_HEX_TAG_AF && info.block_number == 3, "AF tag and block count");
+
+	for (i = 0; i < 3; i++) {
+		ok &= info.block[i].start == blocks[i].start;
+		ok &= info.block[i].end == blocks[i].end;
+		ok &= info.block[i].fix_mem_start == blocks[i].mem;
+	}
+	check(ok, "block ranges and B0 fix_mem_start");
+	check(info.block[3].end == 0, "unused blocks stay empty");
+}
+
+static void test_lowercase_and_eof(void)
+{
+	struct ili_hex_info info;
+	char *text = malloc(hex_len + 32);
+	uint32_t i, len;
+
+	for (i = 0; i <= hex_len; i++)
+		text[i] = (hex[i] >= 'A' && hex[i] <= 'F') ? hex[i] + 'a' - 'A' : hex[i];
+	check(decode(text, hex_len, &info) == 0 && memcmp(out, image, IMAGE_LEN) == 0,
+		"lower case digits");
+
+	/* Without the EOF record the decoder stops at the end of the text */
+	len = strstr(text, ":00000001") - text;
+	check(decode(text, len, &info) == 0 && memcmp(out, image, IMAGE_LEN) == 0,
+		"missing EOF record");
+
+	/* Nothing after EOF is looked at */
+	strcpy(text + len + 13, ":zz\r\n");
+	check(decode(text, len + 18, &info) == 0, "garbage after EOF record");
+	free(text);
+}
+
+static void test_corrupt(void)
+{
+	const char *data = strstr(hex, ":10");
+	uint32_t off = data - hex, eol = strchr(data, '\r') - hex;
+	char c[2] = { 0 };
+
+	/* Flip one data digit, the record checksum no longer adds up */
+	c[0] = (hex[off + 9] == '0') ? '1' : '0';
+	check(decode_patched(off + 9, c, 0) == ILI_HEX_ECHECKSUM, "data digit flipped");
+
+	c[0] = (hex[eol - 1] == '0') ? '1' : '0';
+	check(decode_patched(eol - 1, c, 0) == ILI_HEX_ECHECKSUM, "checksum digit flipped");
+
+	check(decode_patched(off + 9, "G", 0) == ILI_HEX_EFORMAT, "non hex digit");
+	check(decode_patched(off + 1, "G", 0) == ILI_HEX_EFORMAT, "non hex byte count");
+	check(decode_patched(0, NULL, eol - 6) == ILI_HEX_EFORMAT, "record cut short");
+	check(decode_patched(0, NULL, off + 2) == ILI_HEX_EFORMAT, "byte count cut short");
+
+	/* A byte count longer than the record eats the next one and fails */
+	check(decode_patched(off + 1, "20", 0) != 0, "byte count too long");
+}
+
+static void test_records(void)
+{
+	struct ili_hex_info info;
+	char *save = hex;
+	uint32_t save_len = hex_len;
+	uint8_t rec[7] = { 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x07 };
+	char buf[256];
+
+	hex = buf;
+
+	/* Past the end of the image through an extended linear address */
+	hex_len = 0;
+	rec[0] = 0x00;
+	rec[1] = 0x03;
+	emit(0x04, 0, rec, 2);
+	emit(0x00, 0, rec, 7);
+	check(decode(buf, hex_len, &info) == ILI_HEX_ERANGE, "data past the image");
+
+	/* Right at the last byte still fits */
+	hex_len = 0;
+	rec[0] = 0x00;
+	rec[1] = 0x02;
+	emit(0x04, 0, rec, 2);
+	emit(0x00, 0x7FFF, rec, 1);
+	check(decode(buf, hex_len, &info) == 0 && out[IMAGE_LEN - 1] == 0x00, "data ends at the last byte");
+
+	/* Extended segment address is shifted by 4 */
+	hex_len = 0;
+	rec[0] = 0x10;
+	rec[1] = 0x00;
+	emit(0x02, 0, rec, 2);
+	rec[0] = 0x5A;
+	emit(0x00, 0x0001, rec, 1);
+	check(decode(buf, hex_len, &info) == 0 && out[0x10001] == 0x5A, "extended segment address");
+
+	hex_len = 0;
+	emit(0x04, 0, rec, 3);
+	check(decode(buf, hex_len, &info) == ILI_HEX_EFORMAT, "address record of the wrong length");
+
+	hex_len = 0;
+	rec[0] = rec[1] = rec[2] = rec[3] = 0;
+	rec[6] = ILI_HEX_BLOCKS;
+	emit(ILI_HEX_TAG_AF, 0, rec, 7);
+	check(decode(buf, hex_len, &info) == ILI_HEX_EFORMAT, "AF block number out of range");
+
+	hex_len = 0;
+	emit(ILI_HEX_TAG_AF, 0, rec, 6);
+	check(decode(buf, hex_len, &info) == ILI_HEX_EFORMAT, "AF record too short");
+
+	/* B0 only counts after AF, and its block number is checked */
+	hex_len = 0;
+	rec[3] = 1;
+	emit(ILI_HEX_TAG_B0, 0, rec, 4);
+	check(decode(buf, hex_len, &info) == 0 && info.block[1].fix_mem_start == 0, "B0 without AF ignored");
+
+	hex_len = 0;
+	rec[6] = 0;
+	emit(ILI_HEX_TAG_AF, 0, rec, 7);
+	rec[3] = ILI_HEX_BLOCKS;
+	emit(ILI_HEX_TAG_B0, 0, rec, 4);
+	check(decode(buf, hex_len, &info) == ILI_HEX_EFORMAT, "B0 block number out of range");
+
+	/* 03 and 05 carry nothing to load */
+	hex_len = 0;
+	emit(0x03, 0, rec, 4);
+	emit(0x05, 0, rec, 4);
+	check(decode(buf, hex_len, &info) == 0 && info.end_addr == 0, "start address records skipped");
+
+	hex = save;
+	hex_len = save_len;
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void bench(const char *name, const char *text, uint32_t len)
+{
+	struct ili_hex_info info;
+	double t, us;
+	int i, ret = 0;
+
+	t = now_us();
+	for (i = 0; i < BENCH_LOOPS; i++)
+		ret |= ili_hex_decode((const uint8_t *)text, len, out, sizeof(out), &info);
+	us = (now_us() - t) / BENCH_LOOPS;
+
+	printf("%s: %u bytes of hex, %u bytes of image, %.1f us per decode, %.1f MB/s%s\n",
+		name, len, info.end_addr - info.start_addr, us, len / us, ret ? " (decode failed)" : "");
+}
+
+static int bench_file(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	char *text;
+	long size;
+
+	if (f == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	text = malloc(size ? size : 1);
+	if (text == NULL || fread(text, 1, size, f) != (size_t)size) {
+		perror(path);
+		free(text);
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+
+	bench(path, text, size);
+	free(text);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	build_hex();
+
+	test_good();
+	test_lowercase_and_eof();
+	test_corrupt();
+	test_records();
+
+	bench("generated", hex, hex_len);
+	if (argc > 1 && bench_file(argv[1]) < 0)
+		failed++;
+
+	free(hex);
+
+	printf("%s\n", failed ? "FAILED" : "ALL PASSED");
+	return failed ? 1 : 0;
+}
@@ -169,7 +169,7 @@ static ssize_t ilitek_proc_get_delta_data_read(struct file *pFile, char __user *
 {
 	int16_t *delta = NULL;
 	int row = 0, col = 0,  index = 0;
-	int ret, i, x, y;
+	int ret, wait, i, x, y;
 	int read_length = 0;
 	uint8_t cmd[2] = {0};
 	uint8_t *data = NULL;
@@ -202,16 +202,25 @@ static ssize_t ilitek_proc_get_delta_data_read(struct file *pFile, char __user *
 	cmd[0] = 0xB7;
 	cmd[1] = 0x1; //get delta
 
+	core_config_int_wait_arm();
 	ret = core_write(core_config->slave_i2c_addr, &cmd[0], sizeof(cmd));
 	if (ret < 0) {
 		ipio_err("Failed to write 0xB7,0x1 command, %d\n", ret);
+		core_config_int_wait_disarm();
 		goto out;
 	}
 
-	msleep(20);
+	/* fw raises INT once the frame is ready, 20ms at most */
+	wait = core_config_int_wait(20);
+	core_config_int_wait_disarm();
+	if (wait < 0) {
+		ipio_err("Frame not ready within 20ms, %d\n", wait);
+	} else {
+		ipio_debug(DEBUG_CONFIG, "frame ready after %d us\n", wait);
 
-	/* read debug packet header */
-	ret = core_read(core_config->slave_i2c_addr, data, read_length);
+		/* read debug packet header */
+		ret = core_read(core_config->slave_i2c_addr, data, read_length);
+	}
 
 	cmd[1] = 0x03; //switch to normal mode
 	ret = core_write(core_config->slave_i2c_addr, &cmd[0], sizeof(cmd));
@@ -220,6 +229,12 @@ static ssize_t ilitek_proc_get_delta_data_read(struct file *pFile, char __user *
 		goto out;
 	}
 
+	/* don't decode a stale buffer if the frame never came */
+	if (wait < 0) {
+		ret = wait;
+		goto out;
+	}
+
 	for (i = 4, index = 0; index < row * col * 2; i += 2, index++) {
 		delta[index] = (data[i] << 8) + data[i + 1];
 	}
@@ -251,14 +266,14 @@ out:
 	mutex_unlock(&ipd->touch_mutex);
 	ipio_kfree((void **)&data);
 	ipio_kfree((void **)&delta);
-	return nCount;
+	return (ret < 0) ? ret : nCount;
 }
 
 static ssize_t ilitek_proc_fw_get_raw_data_read(struct file *pFile, char __user *buf, size_t nCount, loff_t *pos)
 {
 	int16_t *rawdata = NULL;
 	int row = 0, col = 0,  index = 0;
-	int ret, i, x, y;
+	int ret, wait, i, x, y;
 	int read_length = 0;
 	uint8_t cmd[2] = {0};
 	uint8_t *data = NULL;
@@ -291,16 +306,25 @@ static ssize_t ilitek_proc_fw_get_raw_data_read(struct file *pFile, char __user
 	cmd[0] = 0xB7;
 	cmd[1] = 0x2; //get rawdata
 
+	core_config_int_wait_arm();
 	ret = core_write(core_config->slave_i2c_addr, &cmd[0], sizeof(cmd));
 	if (ret < 0) {
 		ipio_err("Failed to write 0xB7,0x2 command, %d\n", ret);
+		core_config_int_wait_disarm();
 		goto out;
 	}
 
-	msleep(20);
+	/* fw raises INT once the frame is ready, 20ms at most */
+	wait = core_config_int_wait(20);
+	core_config_int_wait_disarm();
+	if (wait < 0) {
+		ipio_err("Frame not ready within 20ms, %d\n", wait);
+	} else {
+		ipio_debug(DEBUG_CONFIG, "frame ready after %d us\n", wait);
 
-	/* read debug packet header */
-	ret = core_read(core_config->slave_i2c_addr, data, read_length);
+		/* read debug packet header */
+		ret = core_read(core_config->slave_i2c_addr, data, read_length);
+	}
 
 	cmd[1] = 0x03; //switch to normal mode
 	ret = core_write(core_config->slave_i2c_addr, &cmd[0], sizeof(cmd));
@@ -309,6 +333,12 @@ static ssize_t ilitek_proc_fw_get_raw_data_read(struct file *pFile, char __user
 		goto out;
 	}
 
+	/* don't decode a stale buffer if the frame never came */
+	if (wait < 0) {
+		ret = wait;
+		goto out;
+	}
+
 	for (i = 4, index = 0; index < row * col * 2; i += 2, index++) {
 		rawdata[index] = (data[i] << 8) + data[i + 1];
 	}
@@ -340,7 +370,7 @@ out:
 	mutex_unlock(&ipd->touch_mutex);
 	ipio_kfree((void **)&data);
 	ipio_kfree((void **)&rawdata);
-	return nCount;
+	return (ret < 0) ? ret : nCount;
 }
 
 static ssize_t ilitek_proc_fw_pc_counter_read(struct file *pFile, char __user *buf, size_t nCount, loff_t *pos)
@@ -547,6 +577,8 @@ static ssize_t ilitek_proc_mp_lcm_on_test_read(struct file *filp, char __user *b
 		return 0;
 	}
 
+	ilitek_platform_resume_wait();
+
 	/* Create the directory for mp_test result */
 	ret = dev_mkdir(CSV_LCM_ON_PATH, S_IRUGO | S_IWUSR);
     if (ret != 0)
@@ -582,6 +614,8 @@ static ssize_t ilitek_proc_mp_lcm_off_test_read(struct file *filp, char __user *
 		return 0;
 	}
 
+	ilitek_platform_resume_wait();
+
 	/* Create the directory for mp_test result */
 	ret = dev_mkdir(CSV_LCM_OFF_PATH, S_IRUGO | S_IWUSR);
     if (ret != 0)
@@ -978,6 +1012,8 @@ static ssize_t ilitek_proc_gesture_read(struct file *filp, char __user *buff, si
 	memset(g_user_buf, 0, USER_STR_BUFF * sizeof(unsigned char));
 
 	len = sprintf(g_user_buf, "isEnableGesture = %d\n", core_config->isEnableGesture);
+	len += sprintf(g_user_buf + len, "suspend = %lld ms, ready wait = %lld ms, download = %lld ms\n",
+			core_gesture->suspend_ms, core_gesture->ready_ms, core_gesture->load_ms);
 
 	ipio_info("isEnableGesture = %d\n", core_config->isEnableGesture);
 
@@ -1074,11 +1110,11 @@ static ssize_t ilitek_proc_check_battery_write(struct file *filp, const char *bu
 	ipio_info("size = %d, cmd = %s\n", (int)size, cmd);
 
 	if (strcmp(cmd, "on") == 0) {
-		ipio_info("Start the thread of check power status\n");
-		queue_delayed_work(ipd->check_power_status_queue, &ipd->check_power_status_work, ipd->work_delay);
+		ipio_info("Follow charger changes\n");
 		ipd->isEnablePollCheckPower = true;
+		ilitek_platform_plug_refresh();
 	} else if (strcmp(cmd, "off") == 0) {
-		ipio_info("Cancel the thread of check power status\n");
+		ipio_info("Stop following charger changes\n");
 		cancel_delayed_work_sync(&ipd->check_power_status_work);
 		ipd->isEnablePollCheckPower = false;
 	} else
@@ -1090,7 +1126,7 @@ out:
 
 static ssize_t ilitek_proc_check_esd_read(struct file *filp, char __user *buff, size_t size, loff_t *pPos)
 {
-	int ret = 0;
+	int ret = 0, i;
 	uint32_t len = 0;
 
 	if (*pPos != 0)
@@ -1099,6 +1135,11 @@ static ssize_t ilitek_proc_check_esd_read(struct file *filp, char __user *buff,
 	memset(g_user_buf, 0, USER_STR_BUFF * sizeof(unsigned char));
 
 	len = sprintf(g_user_buf, "isEnablePollCheckEsd = %d\n", ipd->isEnablePollCheckEsd);
+	len += sprintf(g_user_buf + len, "idle period = %d ms, bad reports = %d\n",
+			jiffies_to_msecs(ipd->esd_check_time), core_fr->bad_report_total);
+	for (i = 0; i < ESD_TIER_NUM; i++)
+		len += sprintf(g_user_buf + len, "%s: try = %d, ok = %d, last = %lld us\n",
+				ilitek_esd_tier_name[i], ipd->esd_try[i], ipd->esd_ok[i], ipd->esd_us[i]);
 
 	ipio_info("isEnablePollCheckEsd = %d\n", ipd->isEnablePollCheckEsd);
 
@@ -1115,6 +1156,7 @@ static ssize_t ilitek_proc_check_esd_read(struct file *filp, char __user *buff,
 static ssize_t ilitek_proc_check_esd_write(struct file *filp, const char *buff, size_t size, loff_t *pPos)
 {
 	int ret = 0;
+	unsigned int ms = 0;
 	char cmd[10] = { 0 };
 
 	if (size > sizeof(cmd)) {
@@ -1146,6 +1188,139 @@ static ssize_t ilitek_proc_check_esd_write(struct file *filp, const char *buff,
 		ipio_info("Cancel the thread of check esd status\n");
 		cancel_delayed_work_sync(&ipd->check_esd_status_work);
 		ipd->isEnablePollCheckEsd = false;
+	} else if (kstrtouint(cmd, 10, &ms) == 0 && ms > 0) {
+		ipio_info("Probe the IC after %d ms without reports\n", ms);
+		ipd->esd_check_time = msecs_to_jiffies(ms);
+		ipd->esd_idle_delay = ipd->esd_check_time;
+		if (ipd->isEnablePollCheckEsd)
+			mod_delayed_work(ipd->check_esd_status_queue,
+				&ipd->check_esd_status_work, ipd->esd_check_time);
+	} else
+		ipio_err("Unknown command\n");
+
+out:
+	return size;
+}
+
+static ssize_t ilitek_proc_probe_read(struct file *filp, char __user *buff, size_t size, loff_t *pPos)
+{
+	int ret = 0, i;
+	uint32_t len = 0;
+
+	if (*pPos != 0)
+		return 0;
+
+	memset(g_user_buf, 0, USER_STR_BUFF * sizeof(unsigned char));
+
+	/* The first stage runs in probe, the rest in probe_work */
+	for (i = 0; i < PROBE_STAGE_NUM; i++)
+		len += sprintf(g_user_buf + len, "%s = %lld us\n", ilitek_probe_stage_name[i], ipd->probe_us[i]);
+
+	len += sprintf(g_user_buf + len, "total = %lld us\n", ipd->probe_total_us);
+
+	ret = copy_to_user((uint32_t *) buff, g_user_buf, len);
+	if (ret < 0) {
+		ipio_err("Failed to copy data to user space\n");
+	}
+
+	*pPos = len;
+
+	return len;
+}
+
+static ssize_t ilitek_proc_resume_read(struct file *filp, char __user *buff, size_t size, loff_t *pPos)
+{
+	int ret = 0;
+	uint32_t len = 0;
+
+	if (*pPos != 0)
+		return 0;
+
+	memset(g_user_buf, 0, USER_STR_BUFF * sizeof(unsigned char));
+
+	/* Both are from the last unblank that had to wake the IC */
+	len = sprintf(g_user_buf, "resume = %lld ms\nfirst touch = %lld ms\n",
+			ipd->resume_ms, ipd->unblank_touch_ms);
+
+	ret = copy_to_user((uint32_t *) buff, g_user_buf, len);
+	if (ret < 0) {
+		ipio_err("Failed to copy data to user space\n");
+	}
+
+	*pPos = len;
+
+	return len;
+}
+
+static ssize_t ilitek_proc_scan_rate_read(struct file *filp, char __user *buff, size_t size, loff_t *pPos)
+{
+	int ret = 0, i, n;
+	uint32_t len = 0;
+	struct scan_rate_event *ev = NULL;
+	static const char *lock_name[] = {"none", "high", "low"};
+
+	if (*pPos != 0)
+		return 0;
+
+	memset(g_user_buf, 0, USER_STR_BUFF * sizeof(unsigned char));
+
+	len = sprintf(g_user_buf, "governor = %d, lock = %s, rate = %s, idle = %d ms\n",
+			core_fr->isEnableScanGov, lock_name[core_fr->scan_lock],
+			core_fr->scan_high ? "high" : "low", jiffies_to_msecs(core_fr->scan_idle_time));
+
+	/* Oldest first, as "<ktime ms> <rate> <reason>" */
+	n = min_t(uint32_t, core_fr->scan_hist_cnt, SCAN_HISTORY_NUM);
+	for (i = 0; i < n; i++) {
+		ev = &core_fr->scan_hist[(core_fr->scan_hist_cnt - n + i) % SCAN_HISTORY_NUM];
+		len += sprintf(g_user_buf + len, "%lld %s %s\n", ev->ms, ev->high ? "high" : "low", ev->why);
+	}
+
+	ret = copy_to_user((uint32_t *) buff, g_user_buf, len);
+	if (ret < 0) {
+		ipio_err("Failed to copy data to user space\n");
+	}
+
+	*pPos = len;
+
+	return len;
+}
+
+static ssize_t ilitek_proc_scan_rate_write(struct file *filp, const char *buff, size_t size, loff_t *pPos)
+{
+	int ret = 0;
+	unsigned int ms = 0;
+	char cmd[10] = { 0 };
+
+	if (size > sizeof(cmd)) {
+		ipio_err("Size is larger than the length of cmd\n");
+		goto out;
+	}
+
+	if (buff != NULL) {
+		ret = copy_from_user(cmd, buff, size - 1);
+		if (ret < 0) {
+			ipio_info("copy data from user space, failed\n");
+			return -1;
+		}
+	}
+
+	ipio_info("size = %d, cmd = %s\n", (int)size, cmd);
+
+	if (strcmp(cmd, "auto") == 0) {
+		ipio_info("Scan rate follows touch activity\n");
+		core_fr_scan_gov_set(true, SCAN_LOCK_NONE);
+	} else if (strcmp(cmd, "high") == 0) {
+		ipio_info("Scan rate locked high\n");
+		core_fr_scan_gov_set(true, SCAN_LOCK_HIGH);
+	} else if (strcmp(cmd, "low") == 0) {
+		ipio_info("Scan rate locked low\n");
+		core_fr_scan_gov_set(true, SCAN_LOCK_LOW);
+	} else if (strcmp(cmd, "off") == 0) {
+		ipio_info("Scan rate governor off\n");
+		core_fr_scan_gov_set(false, SCAN_LOCK_NONE);
+	} else if (kstrtouint(cmd, 10, &ms) == 0 && ms > 0) {
+		ipio_info("Go low after %d ms without fingers\n", ms);
+		core_fr->scan_idle_time = msecs_to_jiffies(ms);
 	} else
 		ipio_err("Unknown command\n");
 
@@ -1182,45 +1357,93 @@ static ssize_t ilitek_proc_fw_process_read(struct file *filp, char __user *buff,
 }
 
 
-static ssize_t ilitek_proc_fw_upgrade_read(struct file *filp, char __user *buff, size_t size, loff_t *pPos)
-{
-	int ret = 0, retry = 0;
-	uint32_t len = 0;
+/*
+ * Upgrades run on their own worker so no proc call blocks for the whole
+ * erase/program/verify. Write "upgrade" or "cancel" to the fw_upgrade node,
+ * read fw_upgrade_status for "<phase> <percent>" and poll it to wait for the
+ * next change. Reading fw_upgrade still upgrades and blocks, as it used to.
+ */
+static struct workqueue_struct *fw_upgrade_wq;
+static struct work_struct fw_upgrade_work;
 
-	retry = core_firmware->retry_times;
+static void ilitek_fw_upgrade_work(struct work_struct *work)
+{
+	int ret = 0;
 
 	ipio_info("Preparing to upgarde firmware\n");
 
-	if (*pPos != 0)
-		return 0;
+	/* Don't race the boot upgrade or a resume that's still reloading the IC */
+	wait_for_completion(&ipd->boot_fw_done);
+	ilitek_platform_resume_wait();
 
-	 memset(g_user_buf, 0, USER_STR_BUFF * sizeof(unsigned char));
+	/* A cancel that came in while queued is kept, core_firmware_upgrade clears it */
+	core_firmware->update_status = 0;
+	core_firmware_set_phase(PHASE_IDLE);
 
+	/* Same as ESD recovery, nobody else may touch the IC meanwhile */
+	mutex_lock(&ipd->plat_mutex);
 	ilitek_platform_disable_irq();
 
+	/* Make sure the new file is parsed rather than the cached image */
+	core_firmware_cache_invalidate();
+
 #ifdef HOST_DOWNLOAD
 	ret = ilitek_platform_reset_ctrl(true, RST_METHODS);
 #else
 	ret = core_firmware_upgrade(UPGRADE_FLASH, HEX_FILE, OPEN_FW_METHOD);
-	if (ret < 0)
-		ipio_err("firmware upgrade failed\n");
 #endif
 
+	/* Image is verified, let touch reports go again */
 	ilitek_platform_enable_irq();
+	mutex_unlock(&ipd->plat_mutex);
 
-	if (ret < 0) {
-		core_firmware->update_status = ret;
+	/* Blank or close events that came in meanwhile were held back */
+	if (ipd->isPowerPending)
+		ilitek_platform_power_update();
+
+	if (ret < 0)
 		ipio_err("Failed to upgrade firwmare\n");
-	} else {
-		core_firmware->update_status = 100;
+	else
 		ipio_info("Succeed to upgrade firmware\n");
+}
+
+static int ilitek_fw_upgrade_start(void)
+{
+	if (!queue_work(fw_upgrade_wq, &fw_upgrade_work)) {
+		ipio_err("Upgrade is already queued\n");
+		return -EBUSY;
+	}
+
+	return 0;
+}
+
+/* Kept for existing tools: reading fw_upgrade runs an upgrade and waits for it */
+static ssize_t ilitek_proc_fw_upgrade_read(struct file *filp, char __user *buff, size_t size, loff_t *pPos)
+{
+	int ret = 0;
+	uint32_t len = 0;
+
+	if (*pPos != 0)
+		return 0;
+
+	if (fw_upgrade_wq == NULL) {
+		ipio_err("work queue isn't created, do nothing\n");
+		return -ENODEV;
 	}
 
-	len = sprintf(g_user_buf, "upgrade firwmare %s\n", (ret < 0) ? "failed" : "succeed");
+	memset(g_user_buf, 0, USER_STR_BUFF * sizeof(unsigned char));
+
+	ret = ilitek_fw_upgrade_start();
+	if (ret < 0)
+		return ret;
+
+	flush_work(&fw_upgrade_work);
+
+	len = sprintf(g_user_buf, "upgrade firwmare %s\n", (core_firmware->update_status < 0) ? "failed" : "succeed");
 
 	ret = copy_to_user((uint32_t *) buff, g_user_buf, len);
 	if (ret < 0) {
-	        ipio_err("Failed to copy data to user space\n");
+		ipio_err("Failed to copy data to user space\n");
 	}
 
 	*pPos = len;
@@ -1228,6 +1451,158 @@ static ssize_t ilitek_proc_fw_upgrade_read(struct file *filp, char __user *buff,
 	return len;
 }
 
+static ssize_t ilitek_proc_fw_upgrade_status_read(struct file *filp, char __user *buff, size_t size, loff_t *pPos)
+{
+	int ret = 0;
+	uint32_t len = 0;
+
+	if (*pPos != 0)
+		return 0;
+
+	memset(g_user_buf, 0, USER_STR_BUFF * sizeof(unsigned char));
+
+	/* Remember which change this reader has seen, for poll */
+	filp->private_data = (void *)(uintptr_t)core_firmware->event;
+
+	len = sprintf(g_user_buf, "%s %d\n", core_firmware_phase_name(core_firmware->phase),
+		(int)core_firmware->update_status);
+
+	if (len > size)
+		len = size;
+
+	ret = copy_to_user(buff, g_user_buf, len);
+	if (ret != 0) {
+		ipio_err("Failed to copy data to user space\n");
+		return -EFAULT;
+	}
+
+	*pPos = len;
+
+	return len;
+}
+
+static ssize_t ilitek_proc_fw_upgrade_write(struct file *filp, const char *buff, size_t size, loff_t *pPos)
+{
+	int ret = 0;
+	char cmd[10] = { 0 };
+
+	if (size > sizeof(cmd)) {
+		ipio_err("Size is larger than the length of cmd\n");
+		goto out;
+	}
+
+	if (fw_upgrade_wq == NULL) {
+		ipio_err("work queue isn't created, do nothing\n");
+		goto out;
+	}
+
+	if (buff != NULL) {
+		ret = copy_from_user(cmd, buff, size - 1);
+		if (ret < 0) {
+			ipio_info("copy data from user space, failed\n");
+			return -1;
+		}
+	}
+
+	ipio_info("size = %d, cmd = %s\n", (int)size, cmd);
+
+	if (strcmp(cmd, "upgrade") == 0) {
+		if (ilitek_fw_upgrade_start() < 0)
+			return -EBUSY;
+	} else if (strcmp(cmd, "cancel") == 0) {
+		if (work_busy(&fw_upgrade_work)) {
+			ipio_info("Cancel the running upgrade\n");
+			core_firmware->isCancel = true;
+		}
+	} else
+		ipio_err("Unknown command\n");
+
+out:
+	return size;
+}
+
+static unsigned int ilitek_proc_fw_upgrade_status_poll(struct file *filp, poll_table *wait)
+{
+	poll_wait(filp, &core_firmware->wq, wait);
+
+	if ((uintptr_t)filp->private_data != core_firmware->event)
+		return POLLIN | POLLRDNORM;
+
+	return 0;
+}
+
+/*
+ * Stream the whole flash to userspace, e.g. cat /proc/ilitek/dump_flash > flash.bin.
+ * The flash is read in one go on open, with the IC to ourselves, and the
+ * reads are served from that copy.
+ */
+static atomic_t dump_flash_users = ATOMIC_INIT(0);
+static uint8_t *dump_flash_buf;
+static uint32_t dump_flash_len;
+
+static int ilitek_proc_dump_flash_open(struct inode *inode, struct file *filp)
+{
+	int ret = 0;
+	bool power = false, esd = false;
+	ktime_t start = ktime_get();
+
+	if (atomic_cmpxchg(&dump_flash_users, 0, 1) != 0)
+		return -EBUSY;
+
+	mutex_lock(&ipd->plat_mutex);
+
+	/* Neither of them should see the IC in ICE mode */
+	power = ipd->isEnablePollCheckPower;
+	if (power) {
+		ipd->isEnablePollCheckPower = false;
+		cancel_delayed_work_sync(&ipd->check_power_status_work);
+	}
+
+	esd = ipd->isEnablePollCheckEsd;
+	if (esd) {
+		ipd->isEnablePollCheckEsd = false;
+		cancel_delayed_work_sync(&ipd->check_esd_status_work);
+	}
+
+	ilitek_platform_disable_irq();
+	ret = core_dump_flash(&dump_flash_buf, &dump_flash_len);
+	ilitek_platform_enable_irq();
+
+	if (power) {
+		ipd->isEnablePollCheckPower = true;
+		ilitek_platform_plug_refresh();
+	}
+	if (esd) {
+		ipd->isEnablePollCheckEsd = true;
+		queue_delayed_work(ipd->check_esd_status_queue,
+			&ipd->check_esd_status_work, ipd->esd_check_time);
+	}
+
+	mutex_unlock(&ipd->plat_mutex);
+
+	if (ret < 0) {
+		atomic_set(&dump_flash_users, 0);
+		return -EIO;
+	}
+
+	ipio_info("Dump flash took %lld ms\n", ktime_to_ms(ktime_sub(ktime_get(), start)));
+	return 0;
+}
+
+static ssize_t ilitek_proc_dump_flash_read(struct file *filp, char __user *buff, size_t size, loff_t *pPos)
+{
+	return simple_read_from_buffer(buff, size, pPos, dump_flash_buf, dump_flash_len);
+}
+
+static int ilitek_proc_dump_flash_release(struct inode *inode, struct file *filp)
+{
+	ipio_vfree((void **)&dump_flash_buf);
+	dump_flash_len = 0;
+
+	atomic_set(&dump_flash_users, 0);
+	return 0;
+}
+
 /* for debug */
 static ssize_t ilitek_proc_ioctl_write(struct file *filp, const char *buff, size_t size, loff_t *pPos)
 {
@@ -1368,6 +1743,24 @@ static ssize_t ilitek_proc_ioctl_write(struct file *filp, const char *buff, size
 #ifdef HOST_DOWNLOAD
 		core_gesture_load_code();
 #endif
+	} else if (strcmp(cmd, "crcbench") == 0) {
+		ipio_info("crc32 table vs bitwise benchmark\n");
+		core_firmware_crc_bench();
+	} else if (strcmp(cmd, "enafwcheck") == 0) {
+		ipio_info("Always check fw crc on boot upgrade\n");
+		core_firmware->isForceCheck = true;
+	} else if (strcmp(cmd, "disfwcheck") == 0) {
+		ipio_info("Check only block crc if the fw version matches\n");
+		core_firmware->isForceCheck = false;
+	} else if (strcmp(cmd, "enaforcedl") == 0) {
+		ipio_info("Always download the whole fw to IRAM\n");
+		core_firmware->isForceDownload = true;
+	} else if (strcmp(cmd, "disforcedl") == 0) {
+		ipio_info("Skip IRAM download if the image is still there\n");
+		core_firmware->isForceDownload = false;
+	} else if (strcmp(cmd, "iramstat") == 0) {
+		ipio_info("IRAM download skipped %d times, done %d times\n",
+			core_firmware->iram_skip, core_firmware->iram_load);
 	} else if (strcmp(cmd, "suspend") == 0) {
 		ipio_info("test suspend test\n");
 		core_config_ic_suspend();
@@ -1699,11 +2092,9 @@ static long ilitek_proc_ioctl(struct file *filp, unsigned int cmd, unsigned long
 		break;
 
 	case ILITEK_IOCTL_TP_DUMP_FLASH:
-		ipio_info("ioctl: dump flash data\n");
-		ret = core_dump_flash();
-		if (ret < 0) {
-			ipio_err("ioctl: Failed to dump flash data\n");
-		}
+		/* The dump no longer goes to a file, it's read from the node */
+		ipio_err("ioctl: dump flash with /proc/ilitek/dump_flash instead\n");
+		ret = -EOPNOTSUPP;
 		break;
 
 	default:
@@ -1738,6 +2129,12 @@ struct file_operations proc_fw_process_fops = {
 
 struct file_operations proc_fw_upgrade_fops = {
 	.read = ilitek_proc_fw_upgrade_read,
+	.write = ilitek_proc_fw_upgrade_write,
+};
+
+struct file_operations proc_fw_upgrade_status_fops = {
+	.read = ilitek_proc_fw_upgrade_status_read,
+	.poll = ilitek_proc_fw_upgrade_status_poll,
 };
 
 struct file_operations proc_gesture_fops = {
@@ -1760,6 +2157,19 @@ struct file_operations proc_debug_level_fops = {
 	.read = ilitek_proc_debug_level_read,
 };
 
+struct file_operations proc_scan_rate_fops = {
+	.write = ilitek_proc_scan_rate_write,
+	.read = ilitek_proc_scan_rate_read,
+};
+
+struct file_operations proc_probe_fops = {
+	.read = ilitek_proc_probe_read,
+};
+
+struct file_operations proc_resume_fops = {
+	.read = ilitek_proc_resume_read,
+};
+
 struct file_operations proc_mp_lcm_on_test_fops = {
 	.read = ilitek_proc_mp_lcm_on_test_read,
 };
@@ -1794,6 +2204,12 @@ struct file_operations proc_get_debug_mode_data_fops = {
 	.write = ilitek_proc_get_debug_mode_data_write,
 };
 
+struct file_operations proc_dump_flash_fops = {
+	.open = ilitek_proc_dump_flash_open,
+	.read = ilitek_proc_dump_flash_read,
+	.release = ilitek_proc_dump_flash_release,
+};
+
 struct file_operations proc_read_write_register_fops = {
 	.read = ilitek_proc_read_write_register_read,
 	.write = ilitek_proc_read_write_register_write,
@@ -1818,9 +2234,13 @@ proc_node_t proc_table[] = {
 	{"ioctl", NULL, &proc_ioctl_fops, false},
 	{"fw_process", NULL, &proc_fw_process_fops, false},
 	{"fw_upgrade", NULL, &proc_fw_upgrade_fops, false},
+	{"fw_upgrade_status", NULL, &proc_fw_upgrade_status_fops, false},
 	{"gesture", NULL, &proc_gesture_fops, false},
 	{"check_battery", NULL, &proc_check_battery_fops, false},
 	{"check_esd", NULL, &proc_check_esd_fops, false},
+	{"scan_rate", NULL, &proc_scan_rate_fops, false},
+	{"probe", NULL, &proc_probe_fops, false},
+	{"resume", NULL, &proc_resume_fops, false},
 	{"debug_level", NULL, &proc_debug_level_fops, false},
 	{"mp_lcm_on_test", NULL, &proc_mp_lcm_on_test_fops, false},
 	{"mp_lcm_off_test", NULL, &proc_mp_lcm_off_test_fops, false},
@@ -1831,6 +2251,7 @@ proc_node_t proc_table[] = {
 	{"show_raw_data", NULL, &proc_get_raw_data_fops, false},
 	{"get_debug_mode_data", NULL, &proc_get_debug_mode_data_fops, false},
 	{"read_write_register", NULL, &proc_read_write_register_fops, false},
+	{"dump_flash", NULL, &proc_dump_flash_fops, false},
 };
 
 #define NETLINK_USER 21
@@ -1939,6 +2360,11 @@ int ilitek_proc_init(void)
 		}
 	}
 
+	INIT_WORK(&fw_upgrade_work, ilitek_fw_upgrade_work);
+	fw_upgrade_wq = create_singlethread_workqueue("ili_fw_upgrade");
+	if (!fw_upgrade_wq)
+		ipio_err("Failed to create a work thread to upgrade firmware\n");
+
 	netlink_init();
 
 	return ret;
@@ -1958,5 +2384,11 @@ void ilitek_proc_remove(void)
 
 	remove_proc_entry("ilitek", NULL);
 	netlink_kernel_release(_gNetLinkSkb);
+
+	if (fw_upgrade_wq) {
+		core_firmware->isCancel = true;
+		destroy_workqueue(fw_upgrade_wq);
+		fw_upgrade_wq = NULL;
+	}
 }
 EXPORT_SYMBOL(ilitek_proc_remove);